@@ -0,0 +1,150 @@
+#include "ce_queue.hpp"
+#include "mpmc_queue.hpp"
+#include "spsc_queue.hpp"
+#include "spsc_ring_buffer.hpp"
+#include "BenchmarkSupport.hpp"
+#include "Platform.hpp"
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+using element = uint64_t;
+
+constexpr int ItemsPerIteration = 10000;
+
+// Uniform push/pop for the queues under test, instantiated for each alignment.
+template<int _align_log2>
+struct spsc_queue_alignment_adapter : spsc_queue<element, 12, _align_log2> {
+    bool push(element e) {
+        return this->produce(e);
+    }
+
+    bool pop(element& e) {
+        return this->consume([&e](element* ptr) {
+            e = *ptr;
+            return true;
+        });
+    }
+};
+
+template<int _align_log2>
+struct spsc_ring_buffer_alignment_adapter : spsc_ring_buffer<16, ctu::log2_v<sizeof(void*)>, ptrdiff_t, _align_log2> {
+    bool push(element e) {
+        return this->produce(sizeof(e), [e](void* ptr) {
+            memcpy(ptr, &e, sizeof(e));
+            return true;
+        });
+    }
+
+    bool pop(element& e) {
+        return this->consume([&e](const void* ptr, ptrdiff_t) {
+            memcpy(&e, ptr, sizeof(e));
+            return true;
+        });
+    }
+};
+
+template<int _align_log2>
+struct ce_queue_alignment_adapter : ce_queue<element, 4096, _align_log2> {
+    bool push(element e) {
+        return this->emplace(e);
+    }
+
+    bool pop(element& e) {
+        return this->consume([&e](element* ptr) {
+            e = *ptr;
+            return true;
+        });
+    }
+};
+
+template<int _align_log2>
+struct mpmc_queue_alignment_adapter : mpmc_queue<element, 4096, _align_log2> {
+    bool push(element e) {
+        return this->Enqueue(e);
+    }
+
+    bool pop(element& e) {
+        return this->Dequeue([&e](element&& value) {
+            e = value;
+        });
+    }
+};
+
+template<typename type>
+static void AlignmentPushPop(benchmark::State& state) {
+    static std::atomic<type*> queue = nullptr;
+
+    const core_pair& pair = core_pair_of(state);
+    state.SetLabel(pair.name);
+
+    if (state.thread_index == 0) {
+        queue = new type{};
+    } else {
+        while (queue.load(std::memory_order_relaxed) == nullptr) {}
+    }
+
+    type& q = *queue;
+    if (state.thread_index == 0) {
+        PREPARE_THREAD(pair.producer_affinity);
+        element e = 0;
+        for (auto _ : state) {
+            int counter = ItemsPerIteration;
+            while (counter > 0) {
+                counter -= int(q.push(e));
+            }
+        }
+    } else if (state.thread_index == 1) {
+        PREPARE_THREAD(pair.consumer_affinity);
+        element e = 0;
+        for (auto _ : state) {
+            int counter = ItemsPerIteration;
+            while (counter > 0) {
+                counter -= int(q.pop(e));
+            }
+        }
+
+        if (q.is_empty() == false) {
+            state.SkipWithError("Not Empty after test");
+        }
+
+        delete queue;
+        queue = nullptr;
+    }
+    state.SetItemsProcessed(state.iterations() * ItemsPerIteration);
+}
+
+// Both threads write their own counter, range(1) bytes apart. Below 64 bytes
+// they share a cache line. Between 64 and 128 bytes they only share the 128
+// byte block the adjacent-line prefetcher fetches as a unit, which is what the
+// default _align_log2 of 7 guards against.
+static void AlignmentFalseSharing(benchmark::State& state) {
+    struct alignas(256) counters {
+        std::atomic<element> slots[512 / sizeof(element)];
+    };
+    static counters shared;
+
+    const core_pair& pair = core_pair_of(state);
+    state.SetLabel(pair.name);
+
+    const auto distance = size_t(state.range(1));
+    auto& counter = shared.slots[state.thread_index == 0 ? 0 : distance / sizeof(element)];
+    if (state.thread_index == 0) {
+        counter.store(0, std::memory_order_relaxed);
+    }
+
+    PREPARE_THREAD(state.thread_index == 0 ? pair.producer_affinity : pair.consumer_affinity);
+    for (auto _ : state) {
+        for (int i = 0; i < ItemsPerIteration; i += 1) {
+            counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * ItemsPerIteration);
+}
+
+BENCHMARK(AlignmentFalseSharing)->Apply(configure_false_sharing);
+
+ALIGNMENT_BENCH(AlignmentPushPop, spsc_queue_alignment_adapter);
+ALIGNMENT_BENCH(AlignmentPushPop, spsc_ring_buffer_alignment_adapter);
+ALIGNMENT_BENCH(AlignmentPushPop, ce_queue_alignment_adapter);
+ALIGNMENT_BENCH(AlignmentPushPop, mpmc_queue_alignment_adapter);
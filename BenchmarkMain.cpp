@@ -0,0 +1,34 @@
+#include <benchmark/benchmark.h>
+#include "BenchmarkRegistry.hpp"
+#include "Platform.hpp"
+#include "scope_guard.hpp"
+#include <atomic>
+#include <thread>
+
+constexpr bool WANT_BACKGROUND_LOAD = false;
+
+// Shared by RingBufferBenchmark and the per-family executables, which only
+// differ in the benchmarks linked into them.
+int main(int argc, char** argv) {
+    if (parse_selection(argc, argv) == false) return 1;
+    register_selected_benchmarks();
+
+    ::benchmark::Initialize(&argc, argv);
+    if (::benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+
+    PREPARE_PROCESS();
+
+    // started only after all arguments are checked, and stopped on every way
+    // out, as a joinable std::thread must not be destroyed
+    std::atomic_bool b{ WANT_BACKGROUND_LOAD == false };
+    std::thread load{ [&b] {
+        PREPARE_THREAD(Thread2Affinity);
+        while (b.load() == false) {}
+    } };
+    scope_guard stop_load([&b, &load] {
+        b.store(true);
+        load.join();
+    });
+
+    ::benchmark::RunSpecifiedBenchmarks();
+}
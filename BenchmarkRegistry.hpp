@@ -0,0 +1,267 @@
+#pragma once
+
+#include <benchmark/benchmark.h>
+#include "Topology.hpp"
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// The queue benchmark macros (QUEUE_BENCH, PING_PONG_BENCH, MPMC_QUEUE_BENCH)
+// add their instances to this registry together with their traits, instead of
+// registering them with Google Benchmark right away. main() reads a selection
+// from the command line or a config file and registers only the instances
+// that match, so choosing queues, element sizes, capacities and thread layouts
+// does not need a rebuild.
+struct benchmark_traits {
+    const char* function;
+    const char* queue;
+    size_t element_size;
+    int capacity_log2; // of the capacity in bytes
+    int producers;
+    int consumers;
+};
+
+struct registered_benchmark {
+    std::string name;
+    benchmark_traits traits;
+    void (*run)(benchmark::State&);
+    void (*configure)(benchmark::internal::Benchmark*);
+    int threads; // 0 if configure sets the number of threads
+};
+
+inline std::vector<registered_benchmark>& benchmark_registry() {
+    static std::vector<registered_benchmark> registry;
+    return registry;
+}
+
+struct benchmark_registrar {
+    benchmark_registrar(const char* name, benchmark_traits traits, void (*run)(benchmark::State&),
+                        void (*configure)(benchmark::internal::Benchmark*), int threads = 0) {
+        benchmark_registry().push_back({ name, traits, run, configure, threads });
+    }
+};
+
+#define RBB_CONCAT_(a, b) a##b
+#define RBB_CONCAT(a, b) RBB_CONCAT_(a, b)
+#define RBB_REGISTRAR static const benchmark_registrar RBB_CONCAT(rbb_registrar_, __COUNTER__)
+
+// An empty list selects everything.
+struct benchmark_selection {
+    std::vector<std::string> functions;
+    std::vector<std::string> queues;
+    std::vector<size_t> element_sizes;
+    std::vector<int> capacities_log2;
+    std::vector<std::string> pairs;
+    std::vector<std::pair<int, int>> layouts; // producers, consumers
+
+    template<typename T>
+    static bool contains(const std::vector<T>& list, const T& value) {
+        if (list.empty())
+            return true;
+        for (auto& e : list) {
+            if (e == value)
+                return true;
+        }
+        return false;
+    }
+
+    bool matches(const benchmark_traits& traits) const {
+        return contains(functions, std::string(traits.function))
+            && contains(queues, std::string(traits.queue))
+            && contains(element_sizes, traits.element_size)
+            && contains(capacities_log2, traits.capacity_log2)
+            && contains(layouts, std::make_pair(traits.producers, traits.consumers));
+    }
+
+    bool selects_pair(const core_pair& pair) const {
+        return contains(pairs, std::string(pair.name));
+    }
+};
+
+inline benchmark_selection& selected_benchmarks() {
+    static benchmark_selection selection;
+    return selection;
+}
+
+namespace registry_detail {
+
+inline std::vector<std::string> split(const std::string& list) {
+    std::vector<std::string> result;
+    size_t begin = 0;
+    while (begin <= list.size()) {
+        auto end = list.find(',', begin);
+        if (end == std::string::npos)
+            end = list.size();
+        if (end > begin)
+            result.push_back(list.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    return result;
+}
+
+inline bool parse_int(const std::string& text, long& value) {
+    char* end = nullptr;
+    value = strtol(text.c_str(), &end, 10);
+    return end != text.c_str() && *end == '\0';
+}
+
+// Applies one key=value setting, returns false if it is malformed.
+inline bool apply_setting(benchmark_selection& selection, const std::string& key, const std::string& value) {
+    if (key == "functions") {
+        selection.functions = split(value);
+    } else if (key == "queues") {
+        selection.queues = split(value);
+    } else if (key == "pairs") {
+        selection.pairs = split(value);
+    } else if (key == "sizes") {
+        selection.element_sizes.clear();
+        for (auto& e : split(value)) {
+            long size;
+            if (parse_int(e, size) == false || size <= 0)
+                return false;
+            selection.element_sizes.push_back(size_t(size));
+        }
+    } else if (key == "capacities") {
+        // log2 of the capacity in bytes, eg. 12,16-20
+        selection.capacities_log2.clear();
+        for (auto& e : split(value)) {
+            auto dash = e.find('-');
+            long first, last;
+            if (dash == std::string::npos) {
+                if (parse_int(e, first) == false)
+                    return false;
+                last = first;
+            } else if (parse_int(e.substr(0, dash), first) == false || parse_int(e.substr(dash + 1), last) == false) {
+                return false;
+            }
+            for (long c = first; c <= last; c += 1) {
+                selection.capacities_log2.push_back(int(c));
+            }
+        }
+    } else if (key == "layouts") {
+        // producers x consumers, eg. 1x1,2x2
+        selection.layouts.clear();
+        for (auto& e : split(value)) {
+            auto x = e.find('x');
+            long producers, consumers;
+            if (x == std::string::npos || parse_int(e.substr(0, x), producers) == false || parse_int(e.substr(x + 1), consumers) == false)
+                return false;
+            selection.layouts.emplace_back(int(producers), int(consumers));
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
+
+inline bool apply_config_file(benchmark_selection& selection, const char* path) {
+    std::ifstream file(path);
+    if (!file) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return false;
+    }
+
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        line_number += 1;
+        auto comment = line.find('#');
+        if (comment != std::string::npos)
+            line.erase(comment);
+        line.erase(0, line.find_first_not_of(" \t\r"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (line.empty())
+            continue;
+
+        auto eq = line.find('=');
+        if (eq == std::string::npos || apply_setting(selection, line.substr(0, eq), line.substr(eq + 1)) == false) {
+            fprintf(stderr, "%s:%d: invalid setting '%s'\n", path, line_number, line.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace registry_detail
+
+// Reads and removes the selection flags from argv, before
+// benchmark::Initialize sees them:
+//   --rbb_config=<file>   key=value lines with the keys below, # comments
+//   --rbb_functions=QueuePushPop,QueuePingPong
+//   --rbb_queues=spsc_queue_adapter,boost_adapter
+//   --rbb_sizes=8,64                element sizes in bytes
+//   --rbb_capacities=12,16-20       log2 of the capacity in bytes
+//   --rbb_pairs=smt,llc             core pairs from Topology.hpp
+//   --rbb_layouts=1x1,2x2           producers x consumers
+// Flags override settings of a config file, wherever they appear.
+inline bool parse_selection(int& argc, char** argv) {
+    auto& selection = selected_benchmarks();
+    const char prefix[] = "--rbb_";
+    const size_t prefix_length = sizeof(prefix) - 1;
+
+    std::vector<std::pair<std::string, std::string>> settings;
+    int kept = 1;
+    for (int i = 1; i < argc; i += 1) {
+        if (strncmp(argv[i], prefix, prefix_length) != 0) {
+            argv[kept++] = argv[i];
+            continue;
+        }
+
+        const char* eq = strchr(argv[i], '=');
+        if (eq == nullptr) {
+            fprintf(stderr, "missing value for %s\n", argv[i]);
+            return false;
+        }
+
+        std::string key(argv[i] + prefix_length, size_t(eq - argv[i]) - prefix_length);
+        if (key == "config") {
+            if (registry_detail::apply_config_file(selection, eq + 1) == false)
+                return false;
+        } else {
+            settings.emplace_back(key, eq + 1);
+        }
+    }
+    argc = kept;
+    argv[argc] = nullptr;
+
+    for (auto& [key, value] : settings) {
+        if (registry_detail::apply_setting(selection, key, value) == false) {
+            fprintf(stderr, "invalid flag --rbb_%s=%s\n", key.c_str(), value.c_str());
+            return false;
+        }
+    }
+
+    if (selection.pairs.empty() == false) {
+        bool any = false;
+        for (auto& pair : core_pairs()) {
+            any = any || selection.selects_pair(pair);
+        }
+        if (any == false) {
+            fprintf(stderr, "no core pair of this machine matches --rbb_pairs\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+// Registers the selected instances with Google Benchmark, returns how many.
+inline size_t register_selected_benchmarks() {
+    size_t count = 0;
+    for (auto& b : benchmark_registry()) {
+        if (selected_benchmarks().matches(b.traits) == false)
+            continue;
+
+        auto* bench = benchmark::RegisterBenchmark(b.name.c_str(), b.run);
+        if (b.threads > 0) {
+            bench->Threads(b.threads);
+        }
+        bench->Apply(b.configure);
+        count += 1;
+    }
+    return count;
+}
@@ -1,42 +1,311 @@
 #pragma once
 
 #include <benchmark/benchmark.h>
+#include "BenchmarkRegistry.hpp"
 #include "DummyContainer.hpp"
+#include "LatencyHistogram.hpp"
+#include "PerfCounters.hpp"
+#include "Platform.hpp"
+#include "Topology.hpp"
+#include "page_alloc.hpp"
+#include "wait_strategy.hpp"
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+// Repetitions of every benchmark instance, RBB_REPETITIONS overrides the
+// default of the configure function. tools/results.py adaptive uses this to
+// run a few repetitions at a time.
+inline int repetitions(int fallback) {
+    static const int configured = [] {
+        const char* value = getenv("RBB_REPETITIONS");
+        return value != nullptr ? atoi(value) : 0;
+    }();
+    return configured > 0 ? configured : fallback;
+}
+
+// Adds one run per representative core pair as the first argument.
+inline void apply_core_pairs(benchmark::internal::Benchmark* bench) {
+    bench->ArgName("pair");
+    for (size_t i = 0; i < core_pairs().size(); i += 1) {
+        if (selected_benchmarks().selects_pair(core_pairs()[i])) {
+            bench->Arg(int64_t(i));
+        }
+    }
+}
+
+inline const core_pair& core_pair_of(const benchmark::State& state) {
+    return core_pairs()[size_t(state.range(0))];
+}
 
 inline void configure_queue(benchmark::internal::Benchmark* bench) {
     bench->Threads(2);
-    bench->Repetitions(200);
-}
-
-#define QUEUE_BENCH_FOR_SIZE(Func, Template, Size)                                                                  \
-    BENCHMARK_TEMPLATE(Func, Template<DummyContainer<Size>, (std::size_t(1) << 12) / Size>)->Apply(configure_queue);\
-    BENCHMARK_TEMPLATE(Func, Template<DummyContainer<Size>, (std::size_t(1) << 13) / Size>)->Apply(configure_queue);\
-    BENCHMARK_TEMPLATE(Func, Template<DummyContainer<Size>, (std::size_t(1) << 14) / Size>)->Apply(configure_queue);\
-    BENCHMARK_TEMPLATE(Func, Template<DummyContainer<Size>, (std::size_t(1) << 15) / Size>)->Apply(configure_queue);\
-    BENCHMARK_TEMPLATE(Func, Template<DummyContainer<Size>, (std::size_t(1) << 16) / Size>)->Apply(configure_queue);\
-    BENCHMARK_TEMPLATE(Func, Template<DummyContainer<Size>, (std::size_t(1) << 17) / Size>)->Apply(configure_queue);\
-    BENCHMARK_TEMPLATE(Func, Template<DummyContainer<Size>, (std::size_t(1) << 18) / Size>)->Apply(configure_queue);\
-    BENCHMARK_TEMPLATE(Func, Template<DummyContainer<Size>, (std::size_t(1) << 19) / Size>)->Apply(configure_queue);\
-    BENCHMARK_TEMPLATE(Func, Template<DummyContainer<Size>, (std::size_t(1) << 20) / Size>)->Apply(configure_queue);\
-    BENCHMARK_TEMPLATE(Func, Template<DummyContainer<Size>, (std::size_t(1) << 21) / Size>)->Apply(configure_queue);\
-    BENCHMARK_TEMPLATE(Func, Template<DummyContainer<Size>, (std::size_t(1) << 22) / Size>)->Apply(configure_queue);\
-    BENCHMARK_TEMPLATE(Func, Template<DummyContainer<Size>, (std::size_t(1) << 23) / Size>)->Apply(configure_queue);\
-    BENCHMARK_TEMPLATE(Func, Template<DummyContainer<Size>, (std::size_t(1) << 24) / Size>)->Apply(configure_queue);\
-    BENCHMARK_TEMPLATE(Func, Template<DummyContainer<Size>, (std::size_t(1) << 25) / Size>)->Apply(configure_queue);\
-    BENCHMARK_TEMPLATE(Func, Template<DummyContainer<Size>, (std::size_t(1) << 26) / Size>)->Apply(configure_queue);\
-    BENCHMARK_TEMPLATE(Func, Template<DummyContainer<Size>, (std::size_t(1) << 27) / Size>)->Apply(configure_queue);\
-    BENCHMARK_TEMPLATE(Func, Template<DummyContainer<Size>, (std::size_t(1) << 28) / Size>)->Apply(configure_queue);\
-    BENCHMARK_TEMPLATE(Func, Template<DummyContainer<Size>, (std::size_t(1) << 29) / Size>)->Apply(configure_queue);\
-    BENCHMARK_TEMPLATE(Func, Template<DummyContainer<Size>, (std::size_t(1) << 30) / Size>)->Apply(configure_queue);
-
-#define QUEUE_BENCH(Func, Template)           \
-    QUEUE_BENCH_FOR_SIZE(Func, Template,  8); \
-    QUEUE_BENCH_FOR_SIZE(Func, Template, 16); \
-    QUEUE_BENCH_FOR_SIZE(Func, Template, 24); \
-    QUEUE_BENCH_FOR_SIZE(Func, Template, 32); \
-    QUEUE_BENCH_FOR_SIZE(Func, Template, 40); \
-    QUEUE_BENCH_FOR_SIZE(Func, Template, 48); \
-    QUEUE_BENCH_FOR_SIZE(Func, Template, 56); \
-    QUEUE_BENCH_FOR_SIZE(Func, Template, 64);
+    bench->Repetitions(repetitions(200));
+    apply_core_pairs(bench);
+}
+
+// Like configure_queue, with the batch size (1..256) as second argument.
+inline void configure_batch_queue(benchmark::internal::Benchmark* bench) {
+    bench->Threads(2);
+    bench->Repetitions(repetitions(200));
+    bench->ArgNames({ "pair", "batch" });
+    for (size_t i = 0; i < core_pairs().size(); i += 1) {
+        if (selected_benchmarks().selects_pair(core_pairs()[i]) == false)
+            continue;
+        for (int64_t batch = 1; batch <= 256; batch *= 2) {
+            bench->Args({ int64_t(i), batch });
+        }
+    }
+}
+
+// Round trips per iteration of the ping-pong benchmarks.
+constexpr int PingPongMessages = 1000;
+
+inline void configure_ping_pong(benchmark::internal::Benchmark* bench) {
+    bench->Threads(2);
+    bench->Repetitions(repetitions(20));
+    apply_core_pairs(bench);
+}
+
+// Reports percentiles of a histogram of read_tsc() deltas as counters in
+// nanoseconds. Only one thread should call this, counters of all threads are
+// summed up.
+template<typename histogram>
+inline void report_latency(benchmark::State& state, const histogram& h) {
+    auto to_ns = [](uint64_t ticks) { return double(ticks) / tsc_ticks_per_ns(); };
+    state.counters["p50_ns"] = to_ns(h.percentile(0.5));
+    state.counters["p99_ns"] = to_ns(h.percentile(0.99));
+    state.counters["p999_ns"] = to_ns(h.percentile(0.999));
+    state.counters["max_ns"] = to_ns(h.max());
+}
+
+// Thread 0 sends a request and waits for the reply before it sends the next
+// one, thread 1 echoes every request. Records the round trip time of each
+// message. push(queue) and pop(queue) make one attempt and return whether it
+// succeeded, the payload is not checked.
+template<typename type, typename push_function, typename pop_function>
+inline void ping_pong(benchmark::State& state, push_function push, pop_function pop) {
+    static std::atomic<type*> requests = nullptr;
+    static std::atomic<type*> replies = nullptr;
+    static std::atomic<int> finished = 0;
+
+    const core_pair& pair = core_pair_of(state);
+    state.SetLabel(pair.name);
+
+    if (state.thread_index == 0) {
+        finished.store(0);
+        replies.store(new type{});
+        requests.store(new type{});
+    } else {
+        while (requests.load() == nullptr) {}
+    }
+    type& request_queue = *requests;
+    type& reply_queue = *replies;
+    if (state.thread_index == 0) {
+        PREPARE_THREAD(pair.producer_affinity);
+        latency_histogram<> histogram;
+        for (auto _ : state) {
+            for (int i = 0; i < PingPongMessages; i += 1) {
+                auto start = read_tsc();
+                while (push(request_queue) == false) {}
+                while (pop(reply_queue) == false) {}
+                histogram.record(read_tsc() - start);
+            }
+        }
+        report_latency(state, histogram);
+        state.SetItemsProcessed(state.iterations() * PingPongMessages);
+    } else if (state.thread_index == 1) {
+        PREPARE_THREAD(pair.consumer_affinity);
+        for (auto _ : state) {
+            for (int i = 0; i < PingPongMessages; i += 1) {
+                while (pop(request_queue) == false) {}
+                while (push(reply_queue) == false) {}
+            }
+        }
+    }
+
+    // the echo thread may still be inside its last enqueue operation when the
+    // reply arrives, so the queues are deleted by whichever thread finishes last
+    if (finished.fetch_add(1) + 1 == 2) {
+        delete requests.load();
+        requests.store(nullptr);
+        delete replies.load();
+        replies.store(nullptr);
+    }
+}
+
+// Stops the counters and reports each one that counted per item, named
+// prefix + counter, eg. producer_cycles. Both threads of a benchmark can
+// report, as long as they use different prefixes.
+inline void report_perf_counters(benchmark::State& state, perf_counters& counters, const char* prefix, int64_t items) {
+    counters.stop();
+    if (items <= 0)
+        return;
+
+    for (int i = 0; i < perf_counters::counter_count; i += 1) {
+        uint64_t value;
+        if (counters.read(perf_counters::counter(i), value)) {
+            state.counters[std::string(prefix) + perf_counters::name_of(i)] = double(value) / double(items);
+        }
+    }
+}
+
+#define QUEUE_BENCH_INSTANCE(Func, Template, Size, CapacityLog2, Configure)                                    \
+    RBB_REGISTRAR(                                                                                             \
+        #Func "<" #Template "<DummyContainer<" #Size ">, (std::size_t(1) << " #CapacityLog2 ") / " #Size ">>", \
+        benchmark_traits{ #Func, #Template, Size, CapacityLog2, 1, 1 },                                        \
+        Func<Template<DummyContainer<Size>, (std::size_t(1) << CapacityLog2) / Size>>, Configure);
+
+#define QUEUE_BENCH_FOR_SIZE_CONFIGURED(Func, Template, Size, Configure) \
+    QUEUE_BENCH_INSTANCE(Func, Template, Size, 12, Configure)            \
+    QUEUE_BENCH_INSTANCE(Func, Template, Size, 13, Configure)            \
+    QUEUE_BENCH_INSTANCE(Func, Template, Size, 14, Configure)            \
+    QUEUE_BENCH_INSTANCE(Func, Template, Size, 15, Configure)            \
+    QUEUE_BENCH_INSTANCE(Func, Template, Size, 16, Configure)            \
+    QUEUE_BENCH_INSTANCE(Func, Template, Size, 17, Configure)            \
+    QUEUE_BENCH_INSTANCE(Func, Template, Size, 18, Configure)            \
+    QUEUE_BENCH_INSTANCE(Func, Template, Size, 19, Configure)            \
+    QUEUE_BENCH_INSTANCE(Func, Template, Size, 20, Configure)            \
+    QUEUE_BENCH_INSTANCE(Func, Template, Size, 21, Configure)            \
+    QUEUE_BENCH_INSTANCE(Func, Template, Size, 22, Configure)            \
+    QUEUE_BENCH_INSTANCE(Func, Template, Size, 23, Configure)            \
+    QUEUE_BENCH_INSTANCE(Func, Template, Size, 24, Configure)            \
+    QUEUE_BENCH_INSTANCE(Func, Template, Size, 25, Configure)            \
+    QUEUE_BENCH_INSTANCE(Func, Template, Size, 26, Configure)            \
+    QUEUE_BENCH_INSTANCE(Func, Template, Size, 27, Configure)            \
+    QUEUE_BENCH_INSTANCE(Func, Template, Size, 28, Configure)            \
+    QUEUE_BENCH_INSTANCE(Func, Template, Size, 29, Configure)            \
+    QUEUE_BENCH_INSTANCE(Func, Template, Size, 30, Configure)
+
+#define QUEUE_BENCH_CONFIGURED(Func, Template, Configure)           \
+    QUEUE_BENCH_FOR_SIZE_CONFIGURED(Func, Template,  8, Configure); \
+    QUEUE_BENCH_FOR_SIZE_CONFIGURED(Func, Template, 16, Configure); \
+    QUEUE_BENCH_FOR_SIZE_CONFIGURED(Func, Template, 24, Configure); \
+    QUEUE_BENCH_FOR_SIZE_CONFIGURED(Func, Template, 32, Configure); \
+    QUEUE_BENCH_FOR_SIZE_CONFIGURED(Func, Template, 40, Configure); \
+    QUEUE_BENCH_FOR_SIZE_CONFIGURED(Func, Template, 48, Configure); \
+    QUEUE_BENCH_FOR_SIZE_CONFIGURED(Func, Template, 56, Configure); \
+    QUEUE_BENCH_FOR_SIZE_CONFIGURED(Func, Template, 64, Configure);
+
+#define QUEUE_BENCH_FOR_SIZE(Func, Template, Size) \
+    QUEUE_BENCH_FOR_SIZE_CONFIGURED(Func, Template, Size, configure_queue)
+
+#define QUEUE_BENCH(Func, Template) \
+    QUEUE_BENCH_CONFIGURED(Func, Template, configure_queue)
+
+// One instance per element size at a single capacity, for queues that do not
+// depend on it, eg. unbounded ones.
+#define QUEUE_BENCH_FOR_CAPACITY(Func, Template, CapacityLog2)              \
+    QUEUE_BENCH_INSTANCE(Func, Template,  8, CapacityLog2, configure_queue) \
+    QUEUE_BENCH_INSTANCE(Func, Template, 16, CapacityLog2, configure_queue) \
+    QUEUE_BENCH_INSTANCE(Func, Template, 24, CapacityLog2, configure_queue) \
+    QUEUE_BENCH_INSTANCE(Func, Template, 32, CapacityLog2, configure_queue) \
+    QUEUE_BENCH_INSTANCE(Func, Template, 40, CapacityLog2, configure_queue) \
+    QUEUE_BENCH_INSTANCE(Func, Template, 48, CapacityLog2, configure_queue) \
+    QUEUE_BENCH_INSTANCE(Func, Template, 56, CapacityLog2, configure_queue) \
+    QUEUE_BENCH_INSTANCE(Func, Template, 64, CapacityLog2, configure_queue)
+
+// Only one element is in flight at any time, so a single small capacity per
+// element size is enough.
+#define PING_PONG_BENCH_FOR_SIZE(Func, Template, Size)                  \
+    QUEUE_BENCH_INSTANCE(Func, Template, Size, 12, configure_ping_pong)
+
+#define PING_PONG_BENCH(Func, Template)           \
+    PING_PONG_BENCH_FOR_SIZE(Func, Template,  8); \
+    PING_PONG_BENCH_FOR_SIZE(Func, Template, 16); \
+    PING_PONG_BENCH_FOR_SIZE(Func, Template, 32); \
+    PING_PONG_BENCH_FOR_SIZE(Func, Template, 64);
+
+inline void configure_mpmc_queue(benchmark::internal::Benchmark* bench) {
+    bench->Repetitions(repetitions(200));
+}
+
+#define MPMC_QUEUE_BENCH_INSTANCE(Func, Template, Size, CapacityLog2, Producers, Consumers)                                                                \
+    RBB_REGISTRAR(                                                                                                                                         \
+        #Func "<" #Template "<DummyContainer<" #Size ">, (std::size_t(1) << " #CapacityLog2 ") / " #Size ">, " #Producers ", " #Consumers ">",             \
+        benchmark_traits{ #Func, #Template, Size, CapacityLog2, Producers, Consumers },                                                                    \
+        Func<Template<DummyContainer<Size>, (std::size_t(1) << CapacityLog2) / Size>, Producers, Consumers>, configure_mpmc_queue, Producers + Consumers);
+
+#define MPMC_QUEUE_BENCH_FOR_SIZE(Func, Template, Size, Producers, Consumers) \
+    MPMC_QUEUE_BENCH_INSTANCE(Func, Template, Size, 12, Producers, Consumers) \
+    MPMC_QUEUE_BENCH_INSTANCE(Func, Template, Size, 16, Producers, Consumers) \
+    MPMC_QUEUE_BENCH_INSTANCE(Func, Template, Size, 20, Producers, Consumers)
+
+#define MPMC_QUEUE_BENCH(Func, Template, Producers, Consumers)           \
+    MPMC_QUEUE_BENCH_FOR_SIZE(Func, Template,  8, Producers, Consumers); \
+    MPMC_QUEUE_BENCH_FOR_SIZE(Func, Template, 16, Producers, Consumers); \
+    MPMC_QUEUE_BENCH_FOR_SIZE(Func, Template, 32, Producers, Consumers); \
+    MPMC_QUEUE_BENCH_FOR_SIZE(Func, Template, 64, Producers, Consumers);
+
+// Like configure_queue, with the interval between two messages in microseconds
+// as second argument. 0 sends back to back, the larger intervals leave the
+// consumer idle most of the time.
+inline void configure_wait_strategy_queue(benchmark::internal::Benchmark* bench) {
+    bench->Threads(2);
+    bench->Repetitions(repetitions(20));
+    bench->ArgNames({ "pair", "interval_us" });
+    for (size_t i = 0; i < core_pairs().size(); i += 1) {
+        if (selected_benchmarks().selects_pair(core_pairs()[i]) == false)
+            continue;
+        for (int64_t interval : { 0, 1, 10, 100 }) {
+            bench->Args({ int64_t(i), interval });
+        }
+    }
+}
+
+// Template is instantiated with each wait strategy.
+#define WAIT_STRATEGY_BENCH(Func, Template)                                                                   \
+    BENCHMARK_TEMPLATE(Func, Template<busy_spin_wait>)->Apply(configure_wait_strategy_queue);                 \
+    BENCHMARK_TEMPLATE(Func, Template<pause_backoff_wait<>>)->Apply(configure_wait_strategy_queue);           \
+    BENCHMARK_TEMPLATE(Func, Template<spin_yield_wait<>>)->Apply(configure_wait_strategy_queue);              \
+    BENCHMARK_TEMPLATE(Func, Template<futex_wait<>>)->Apply(configure_wait_strategy_queue);
+
+inline void configure_page_size_queue(benchmark::internal::Benchmark* bench) {
+    bench->Threads(2);
+    bench->Repetitions(repetitions(20));
+    apply_core_pairs(bench);
+}
+
+#define PAGE_SIZE_BENCH_FOR_SIZE(Func, Template, SizeLog2)                                                                             \
+    BENCHMARK_TEMPLATE(Func, Template<small_page_allocator, SizeLog2>)->Apply(configure_page_size_queue);                             \
+    BENCHMARK_TEMPLATE(Func, Template<transparent_huge_page_allocator, SizeLog2>)->Apply(configure_page_size_queue);                  \
+    BENCHMARK_TEMPLATE(Func, Template<huge_page_allocator<21>, SizeLog2>)->Apply(configure_page_size_queue);                          \
+    BENCHMARK_TEMPLATE(Func, Template<huge_page_allocator<30>, SizeLog2>)->Apply(configure_page_size_queue);
+
+// Template is instantiated with each page allocator from page_alloc.hpp and the
+// log2 of the buffer size in bytes.
+#define PAGE_SIZE_BENCH(Func, Template)           \
+    PAGE_SIZE_BENCH_FOR_SIZE(Func, Template, 20); \
+    PAGE_SIZE_BENCH_FOR_SIZE(Func, Template, 24); \
+    PAGE_SIZE_BENCH_FOR_SIZE(Func, Template, 27); \
+    PAGE_SIZE_BENCH_FOR_SIZE(Func, Template, 30);
+
+inline void configure_alignment_queue(benchmark::internal::Benchmark* bench) {
+    bench->Threads(2);
+    bench->Repetitions(repetitions(20));
+    apply_core_pairs(bench);
+}
+
+// Like configure_alignment_queue, with the distance in bytes between the data
+// of both threads as second argument.
+inline void configure_false_sharing(benchmark::internal::Benchmark* bench) {
+    bench->Threads(2);
+    bench->Repetitions(repetitions(20));
+    bench->ArgNames({ "pair", "distance" });
+    for (size_t i = 0; i < core_pairs().size(); i += 1) {
+        if (selected_benchmarks().selects_pair(core_pairs()[i]) == false)
+            continue;
+        for (int64_t distance = 8; distance <= 256; distance *= 2) {
+            bench->Args({ int64_t(i), distance });
+        }
+    }
+}
 
+// Template is instantiated with _align_log2 from 5 (32 bytes) to 8 (256 bytes).
+#define ALIGNMENT_BENCH(Func, Template)                                            \
+    BENCHMARK_TEMPLATE(Func, Template<5>)->Apply(configure_alignment_queue);       \
+    BENCHMARK_TEMPLATE(Func, Template<6>)->Apply(configure_alignment_queue);       \
+    BENCHMARK_TEMPLATE(Func, Template<7>)->Apply(configure_alignment_queue);       \
+    BENCHMARK_TEMPLATE(Func, Template<8>)->Apply(configure_alignment_queue);
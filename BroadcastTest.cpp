@@ -0,0 +1,71 @@
+#include "spmc_broadcast_ring_buffer.hpp"
+#include "BenchmarkSupport.hpp"
+#include "Platform.hpp"
+#include <atomic>
+#include <cstring>
+#include <new>
+
+constexpr int BroadcastRecords = 10000;
+
+// Thread 0 produces, every other thread is a reader and consumes every
+// record. Like MPMCQueueTest, threads are not pinned.
+template<typename type, size_t record_size>
+static void BroadcastProduceConsume(benchmark::State& state) {
+    static std::atomic<type*> queue = nullptr;
+    static std::atomic<int> finished = 0;
+
+    if (state.thread_index == 0) {
+        finished.store(0);
+        queue.store(new type{ size_t(state.threads - 1) });
+    } else {
+        while (queue.load() == nullptr) {}
+    }
+
+    type& q = *queue;
+    if (state.thread_index == 0) {
+        for (auto _ : state) {
+            int counter = BroadcastRecords;
+            while (counter > 0) {
+                counter -= int(q.produce(record_size, [](void* ptr) {
+                    memset(ptr, 0, record_size);
+                    return true;
+                }));
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * BroadcastRecords);
+        state.SetBytesProcessed(state.iterations() * BroadcastRecords * record_size);
+    } else {
+        const size_t reader = size_t(state.thread_index - 1);
+        alignas(16) std::byte copy[record_size];
+        for (auto _ : state) {
+            int counter = BroadcastRecords;
+            while (counter > 0) {
+                counter -= int(q.consume(reader, [&copy](const void* ptr, ptrdiff_t) {
+                    memcpy(copy, ptr, record_size);
+                    benchmark::DoNotOptimize(copy);
+                    return true;
+                }));
+            }
+        }
+    }
+
+    if (finished.fetch_add(1) + 1 == state.threads) {
+        if (q.is_empty() == false) {
+            state.SkipWithError("Not Empty after test");
+        }
+
+        delete queue.load();
+        queue.store(nullptr);
+    }
+}
+
+// 1 to 8 readers, plus the producer
+inline void configure_broadcast(benchmark::internal::Benchmark* bench) {
+    bench->Repetitions(repetitions(20));
+    bench->DenseThreadRange(2, 9);
+}
+
+BENCHMARK_TEMPLATE(BroadcastProduceConsume, spmc_broadcast_ring_buffer<16>, 56)->Apply(configure_broadcast);
+BENCHMARK_TEMPLATE(BroadcastProduceConsume, spmc_broadcast_ring_buffer<20>, 56)->Apply(configure_broadcast);
+BENCHMARK_TEMPLATE(BroadcastProduceConsume, spmc_broadcast_ring_buffer<16>, 248)->Apply(configure_broadcast);
+BENCHMARK_TEMPLATE(BroadcastProduceConsume, spmc_broadcast_ring_buffer<20>, 248)->Apply(configure_broadcast);
@@ -13,6 +13,9 @@ template<typename type>
 static void ChunkedQueueTest(benchmark::State& state) {
     static std::atomic<type*> queue = nullptr;
 
+    const core_pair& pair = core_pair_of(state);
+    state.SetLabel(pair.name);
+
     if (state.thread_index == 0) {
         queue.store(new type{});
     } else {
@@ -21,21 +24,27 @@ static void ChunkedQueueTest(benchmark::State& state) {
 
     type& q = *queue;
     if (state.thread_index == 0) {
-        PREPARE_THREAD(Thread1Affinity);
+        PREPARE_THREAD(pair.producer_affinity);
+        perf_counters counters;
         for (auto _ : state) {
+            counters.start();
             int counter = 10000;
             while (counter > 0) {
                 counter -= int(q.Enqueue());
             }
         }
+        report_perf_counters(state, counters, "producer_", state.iterations() * 10000);
     } else if (state.thread_index == 1) {
-        PREPARE_THREAD(Thread2Affinity);
+        PREPARE_THREAD(pair.consumer_affinity);
+        perf_counters counters;
         for (auto _ : state) {
+            counters.start();
             int counter = 10000;
             while (counter > 0) {
                 counter -= int(q.Dequeue([](typename type::value_type&&) {}));
             }
         }
+        report_perf_counters(state, counters, "consumer_", state.iterations() * 10000);
 
         delete queue.load();
         queue.store(nullptr);
@@ -44,6 +53,14 @@ static void ChunkedQueueTest(benchmark::State& state) {
     state.SetBytesProcessed(state.iterations() * 10000 * sizeof(typename type::value_type));
 }
 
+// Round trip time, see ping_pong.
+template<typename type>
+static void ChunkedQueuePingPong(benchmark::State& state) {
+    ping_pong<type>(state,
+        [](type& q) { return q.Enqueue(); },
+        [](type& q) { return q.Dequeue([](typename type::value_type&&) {}); });
+}
+
 QUEUE_BENCH(ChunkedQueueTest, ChunkedQueue1);
 QUEUE_BENCH(ChunkedQueueTest, ChunkedQueue2);
 QUEUE_BENCH(ChunkedQueueTest, ChunkedQueue3);
@@ -51,3 +68,11 @@ QUEUE_BENCH(ChunkedQueueTest, ChunkedQueue4);
 QUEUE_BENCH(ChunkedQueueTest, ChunkedQueue5);
 QUEUE_BENCH(ChunkedQueueTest, ChunkedQueue6);
 QUEUE_BENCH(ChunkedQueueTest, ChunkedQueue7);
+
+PING_PONG_BENCH(ChunkedQueuePingPong, ChunkedQueue1);
+PING_PONG_BENCH(ChunkedQueuePingPong, ChunkedQueue2);
+PING_PONG_BENCH(ChunkedQueuePingPong, ChunkedQueue3);
+PING_PONG_BENCH(ChunkedQueuePingPong, ChunkedQueue4);
+PING_PONG_BENCH(ChunkedQueuePingPong, ChunkedQueue5);
+PING_PONG_BENCH(ChunkedQueuePingPong, ChunkedQueue6);
+PING_PONG_BENCH(ChunkedQueuePingPong, ChunkedQueue7);
@@ -12,6 +12,9 @@ template<typename type>
 static void FastForwardTest(benchmark::State& state) {
     static std::atomic<type*> queue = nullptr;
 
+    const core_pair& pair = core_pair_of(state);
+    state.SetLabel(pair.name);
+
     if (state.thread_index == 0) {
         queue.store(new type{});
     } else {
@@ -21,22 +24,28 @@ static void FastForwardTest(benchmark::State& state) {
     static typename type::value_type value{};
     type& q = *queue;
     if (state.thread_index == 0) {
-        PREPARE_THREAD(Thread1Affinity);
+        PREPARE_THREAD(pair.producer_affinity);
+        perf_counters counters;
         for (auto _ : state) {
+            counters.start();
             int counter = 10000;
             while (counter > 0) {
                 counter -= int(q.Enqueue(&value));
             }
         }
+        report_perf_counters(state, counters, "producer_", state.iterations() * 10000);
     } else if (state.thread_index == 1) {
-        PREPARE_THREAD(Thread2Affinity);
+        PREPARE_THREAD(pair.consumer_affinity);
         typename type::value_type* out;
+        perf_counters counters;
         for (auto _ : state) {
+            counters.start();
             int counter = 10000;
             while (counter > 0) {
                 counter -= int(q.Dequeue(out));
             }
         }
+        report_perf_counters(state, counters, "consumer_", state.iterations() * 10000);
 
         delete queue.load();
         queue.store(nullptr);
@@ -45,9 +54,31 @@ static void FastForwardTest(benchmark::State& state) {
     state.SetBytesProcessed(state.iterations() * 10000 * sizeof(typename type::value_type));
 }
 
+// Round trip time, see ping_pong. FastForward passes pointers, every message
+// points to the same element.
+template<typename type>
+static void FastForwardPingPong(benchmark::State& state) {
+    ping_pong<type>(state,
+        [](type& q) {
+            static typename type::value_type value{};
+            return q.Enqueue(&value);
+        },
+        [](type& q) {
+            typename type::value_type* out;
+            return q.Dequeue(out);
+        });
+}
+
 QUEUE_BENCH_FOR_SIZE(FastForwardTest, FastForward1, 8);
 QUEUE_BENCH_FOR_SIZE(FastForwardTest, FastForward2, 8);
 QUEUE_BENCH_FOR_SIZE(FastForwardTest, FastForward3, 8);
 QUEUE_BENCH_FOR_SIZE(FastForwardTest, FastForward4, 8);
 QUEUE_BENCH_FOR_SIZE(FastForwardTest, FastForward5, 8);
 QUEUE_BENCH_FOR_SIZE(FastForwardTest, FastForward6, 8);
+
+PING_PONG_BENCH_FOR_SIZE(FastForwardPingPong, FastForward1, 8);
+PING_PONG_BENCH_FOR_SIZE(FastForwardPingPong, FastForward2, 8);
+PING_PONG_BENCH_FOR_SIZE(FastForwardPingPong, FastForward3, 8);
+PING_PONG_BENCH_FOR_SIZE(FastForwardPingPong, FastForward4, 8);
+PING_PONG_BENCH_FOR_SIZE(FastForwardPingPong, FastForward5, 8);
+PING_PONG_BENCH_FOR_SIZE(FastForwardPingPong, FastForward6, 8);
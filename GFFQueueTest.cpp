@@ -11,6 +11,9 @@ template<typename type>
 static void GFFQueueTest(benchmark::State& state) {
     static std::atomic<type*> queue = nullptr;
 
+    const core_pair& pair = core_pair_of(state);
+    state.SetLabel(pair.name);
+
     if (state.thread_index == 0) {
         queue.store(new type{});
     } else {
@@ -19,21 +22,27 @@ static void GFFQueueTest(benchmark::State& state) {
 
     type& q = *queue;
     if (state.thread_index == 0) {
-        PREPARE_THREAD(Thread1Affinity);
+        PREPARE_THREAD(pair.producer_affinity);
+        perf_counters counters;
         for (auto _ : state) {
+            counters.start();
             int counter = 10000;
             while (counter > 0) {
                 counter -= int(q.Enqueue());
             }
         }
+        report_perf_counters(state, counters, "producer_", state.iterations() * 10000);
     } else if (state.thread_index == 1) {
-        PREPARE_THREAD(Thread2Affinity);
+        PREPARE_THREAD(pair.consumer_affinity);
+        perf_counters counters;
         for (auto _ : state) {
+            counters.start();
             int counter = 10000;
             while (counter > 0) {
                 counter -= int(q.Dequeue([](typename type::value_type&&) {}));
             }
         }
+        report_perf_counters(state, counters, "consumer_", state.iterations() * 10000);
         
         delete queue.load();
         queue.store(nullptr);
@@ -42,8 +51,22 @@ static void GFFQueueTest(benchmark::State& state) {
     state.SetBytesProcessed(state.iterations() * 10000 * sizeof(typename type::value_type));
 }
 
+// Round trip time, see ping_pong.
+template<typename type>
+static void GFFQueuePingPong(benchmark::State& state) {
+    ping_pong<type>(state,
+        [](type& q) { return q.Enqueue(); },
+        [](type& q) { return q.Dequeue([](typename type::value_type&&) {}); });
+}
+
 QUEUE_BENCH(GFFQueueTest, GFFQueue1);
 QUEUE_BENCH(GFFQueueTest, GFFQueue2);
 QUEUE_BENCH(GFFQueueTest, GFFQueue3);
 QUEUE_BENCH(GFFQueueTest, GFFQueue4);
 QUEUE_BENCH(GFFQueueTest, GFFQueue5);
+
+PING_PONG_BENCH(GFFQueuePingPong, GFFQueue1);
+PING_PONG_BENCH(GFFQueuePingPong, GFFQueue2);
+PING_PONG_BENCH(GFFQueuePingPong, GFFQueue3);
+PING_PONG_BENCH(GFFQueuePingPong, GFFQueue4);
+PING_PONG_BENCH(GFFQueuePingPong, GFFQueue5);
@@ -14,6 +14,9 @@ template<typename type>
 static void LamportQueueTest(benchmark::State& state) {
     static std::atomic<type*> queue = nullptr;
 
+    const core_pair& pair = core_pair_of(state);
+    state.SetLabel(pair.name);
+
     if (state.thread_index == 0) {
         queue.store(new type{});
     } else {
@@ -22,21 +25,27 @@ static void LamportQueueTest(benchmark::State& state) {
 
     type& q = *queue;
     if (state.thread_index == 0) {
-        PREPARE_THREAD(Thread1Affinity);
+        PREPARE_THREAD(pair.producer_affinity);
+        perf_counters counters;
         for (auto _ : state) {
+            counters.start();
             int counter = 10000;
             while (counter > 0) {
                 counter -= int(q.Enqueue());
             }
         }
+        report_perf_counters(state, counters, "producer_", state.iterations() * 10000);
     } else if (state.thread_index == 1) {
-        PREPARE_THREAD(Thread2Affinity);
+        PREPARE_THREAD(pair.consumer_affinity);
+        perf_counters counters;
         for (auto _ : state) {
+            counters.start();
             int counter = 10000;
             while (counter > 0) {
                 counter -= int(q.Dequeue([](typename type::value_type&&) {}));
             }
         }
+        report_perf_counters(state, counters, "consumer_", state.iterations() * 10000);
 
         delete queue.load();
         queue.store(nullptr);
@@ -45,6 +54,14 @@ static void LamportQueueTest(benchmark::State& state) {
     state.SetBytesProcessed(state.iterations() * 10000 * sizeof(typename type::value_type));
 }
 
+// Round trip time, see ping_pong.
+template<typename type>
+static void LamportQueuePingPong(benchmark::State& state) {
+    ping_pong<type>(state,
+        [](type& q) { return q.Enqueue(); },
+        [](type& q) { return q.Dequeue([](typename type::value_type&&) {}); });
+}
+
 QUEUE_BENCH(LamportQueueTest, LamportQueue2);
 QUEUE_BENCH(LamportQueueTest, LamportQueue3);
 QUEUE_BENCH(LamportQueueTest, LamportQueue4);
@@ -53,3 +70,12 @@ QUEUE_BENCH(LamportQueueTest, LamportQueue6);
 QUEUE_BENCH(LamportQueueTest, LamportQueue7);
 QUEUE_BENCH(LamportQueueTest, LamportQueue8);
 QUEUE_BENCH(LamportQueueTest, LamportQueue9);
+
+PING_PONG_BENCH(LamportQueuePingPong, LamportQueue2);
+PING_PONG_BENCH(LamportQueuePingPong, LamportQueue3);
+PING_PONG_BENCH(LamportQueuePingPong, LamportQueue4);
+PING_PONG_BENCH(LamportQueuePingPong, LamportQueue5);
+PING_PONG_BENCH(LamportQueuePingPong, LamportQueue6);
+PING_PONG_BENCH(LamportQueuePingPong, LamportQueue7);
+PING_PONG_BENCH(LamportQueuePingPong, LamportQueue8);
+PING_PONG_BENCH(LamportQueuePingPong, LamportQueue9);
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Log-linear histogram in the style of HdrHistogram. Values below
+// sub_bucket_count are recorded exactly. Larger values are grouped by their
+// highest set bit, and each of these ranges is split into sub_bucket_count
+// equally sized buckets, so every value is reproduced with a relative error
+// below 1 / sub_bucket_count. Recording is a handful of instructions and never
+// allocates, the whole value range of uint64_t is covered.
+template<int _sub_bucket_bits = 7>
+struct latency_histogram {
+    static const int sub_bucket_bits = _sub_bucket_bits;
+    static const uint64_t sub_bucket_count = uint64_t(1) << sub_bucket_bits;
+    static const size_t bucket_count = size_t(sub_bucket_count) * (64 - sub_bucket_bits + 1);
+
+    static_assert(sub_bucket_bits > 0 && sub_bucket_bits < 32);
+
+    void record(uint64_t value) noexcept {
+        _counts[index_of(value)] += 1;
+        _total += 1;
+        if (value > _max) {
+            _max = value;
+        }
+    }
+
+    void reset() noexcept {
+        _counts.fill(0);
+        _total = 0;
+        _max = 0;
+    }
+
+    // Smallest recorded value v, rounded up to its bucket, so that at least
+    // fraction (0..1) of all recorded values are less than or equal to v.
+    uint64_t percentile(double fraction) const noexcept {
+        if (_total == 0)
+            return 0;
+
+        auto rank = uint64_t(fraction * double(_total) + 0.5);
+        if (rank < 1) rank = 1;
+        if (rank > _total) rank = _total;
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < bucket_count; i += 1) {
+            seen += _counts[i];
+            if (seen >= rank) {
+                auto highest = highest_value_of(i);
+                return highest < _max ? highest : _max;
+            }
+        }
+        return _max;
+    }
+
+    uint64_t max() const noexcept {
+        return _max;
+    }
+
+    uint64_t total() const noexcept {
+        return _total;
+    }
+
+    static size_t index_of(uint64_t value) noexcept {
+        if (value < sub_bucket_count)
+            return size_t(value);
+
+        int shift = highest_bit(value) - sub_bucket_bits;
+        return size_t(uint64_t(shift + 1) * sub_bucket_count + ((value >> shift) - sub_bucket_count));
+    }
+
+    static uint64_t highest_value_of(size_t index) noexcept {
+        if (index < sub_bucket_count)
+            return uint64_t(index);
+
+        auto shift = int(index / sub_bucket_count) - 1;
+        auto sub_bucket = uint64_t(index % sub_bucket_count) + sub_bucket_count;
+        return ((sub_bucket + 1) << shift) - 1;
+    }
+
+private:
+    static int highest_bit(uint64_t value) noexcept {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return int(index);
+#else
+        return 63 - __builtin_clzll(value);
+#endif
+    }
+
+    std::array<uint64_t, bucket_count> _counts{};
+    uint64_t _total = 0;
+    uint64_t _max = 0;
+};
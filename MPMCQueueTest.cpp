@@ -0,0 +1,70 @@
+#include "mpmc_queue.hpp"
+#include "BenchmarkSupport.hpp"
+#include "Platform.hpp"
+#include <atomic>
+#include <new>
+
+// Per iteration, producers enqueue a total of 10000 elements, which are split
+// evenly across all consumers. Threads are not pinned, as there is no single
+// core pair that describes an N x M layout.
+template<typename type, int producers, int consumers>
+static void MPMCQueueTest(benchmark::State& state) {
+    static_assert(10000 % producers == 0 && 10000 % consumers == 0);
+
+    static std::atomic<type*> queue = nullptr;
+    static std::atomic<int> finished = 0;
+
+    if (state.thread_index == 0) {
+        finished.store(0);
+        queue.store(new type{});
+    } else {
+        while (queue.load() == nullptr) {}
+    }
+
+    type& q = *queue;
+    if (state.thread_index < producers) {
+        for (auto _ : state) {
+            int counter = 10000 / producers;
+            while (counter > 0) {
+                counter -= int(q.Enqueue());
+            }
+        }
+    } else {
+        for (auto _ : state) {
+            int counter = 10000 / consumers;
+            while (counter > 0) {
+                counter -= int(q.Dequeue([](typename type::value_type&&) {}));
+            }
+        }
+
+        // only count consumed elements, so every element is counted once
+        state.SetItemsProcessed(state.iterations() * (10000 / consumers));
+        state.SetBytesProcessed(state.iterations() * (10000 / consumers) * sizeof(typename type::value_type));
+    }
+
+    if (finished.fetch_add(1) + 1 == producers + consumers) {
+        if (q.is_empty() == false) {
+            state.SkipWithError("Not Empty after test");
+        }
+
+        delete queue.load();
+        queue.store(nullptr);
+    }
+}
+
+// Round trip time, see ping_pong. Unlike MPMCQueueTest, threads are pinned to
+// a core pair, as only one producer and one consumer use each queue.
+template<typename type>
+static void MPMCQueuePingPong(benchmark::State& state) {
+    ping_pong<type>(state,
+        [](type& q) { return q.Enqueue(); },
+        [](type& q) { return q.Dequeue([](typename type::value_type&&) {}); });
+}
+
+MPMC_QUEUE_BENCH(MPMCQueueTest, mpmc_queue, 1, 1);
+MPMC_QUEUE_BENCH(MPMCQueueTest, mpmc_queue, 1, 2);
+MPMC_QUEUE_BENCH(MPMCQueueTest, mpmc_queue, 2, 1);
+MPMC_QUEUE_BENCH(MPMCQueueTest, mpmc_queue, 2, 2);
+MPMC_QUEUE_BENCH(MPMCQueueTest, mpmc_queue, 4, 4);
+
+PING_PONG_BENCH(MPMCQueuePingPong, mpmc_queue);
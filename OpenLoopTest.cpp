@@ -0,0 +1,173 @@
+#include "ChunkedQueue7.hpp"
+#include "FastForward6.hpp"
+#include "GFFQueue5.hpp"
+#include "LamportQueue9.hpp"
+#include "MCRingBuffer7.hpp"
+#include "spsc_queue.hpp"
+#include "spsc_queue_release.hpp"
+#include "BenchmarkSupport.hpp"
+#include "LatencyHistogram.hpp"
+#include "Platform.hpp"
+#include <array>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// read_tsc() at the time the message was scheduled to be sent
+using timestamp = uint64_t;
+
+constexpr int MessagesPerIteration = 10000;
+constexpr size_t QueueCapacity = 4096;
+
+// Args are the core pair and the target rate in million messages per second.
+inline void configure_open_loop(benchmark::internal::Benchmark* bench) {
+    bench->Threads(2);
+    bench->Repetitions(repetitions(20));
+    bench->ArgNames({ "pair", "mmsg_per_s" });
+    for (size_t i = 0; i < core_pairs().size(); i += 1) {
+        if (selected_benchmarks().selects_pair(core_pairs()[i]) == false)
+            continue;
+        for (int64_t rate : { 1, 2, 5, 10, 20, 50, 100 }) {
+            bench->Args({ int64_t(i), rate });
+        }
+    }
+}
+
+// The Lamport, FastForward, MCRingBuffer, GFF and Chunked families cannot
+// look into the queue without popping from it, they are not checked.
+template<typename type, typename = void>
+struct has_is_empty : std::false_type {};
+
+template<typename type>
+struct has_is_empty<type, std::void_t<decltype(std::declval<const type&>().is_empty())>> : std::true_type {};
+
+// Open loop: message n is due at start + n / rate, whether or not the queue
+// kept up with the messages before it. The producer waits on read_tsc() for
+// messages that are not due yet, and sends late ones immediately, retrying
+// while the queue is full. The consumer records the latency of each message
+// from its due time, so a stall of the queue shows up in the latency of every
+// message scheduled during the stall instead of only delaying the producer
+// (coordinated omission). The schedule runs on across iterations. When the
+// queue cannot sustain the rate, latency grows with the run time and
+// items_per_second stays below the target. The schedule starts with the
+// first iteration, after both threads are set up.
+template<typename type>
+static void OpenLoop(benchmark::State& state) {
+    static std::atomic<type*> queue = nullptr;
+
+    const core_pair& pair = core_pair_of(state);
+    state.SetLabel(pair.name);
+
+    if (state.thread_index == 0) {
+        queue = new type{};
+    } else {
+        while (queue.load(std::memory_order_relaxed) == nullptr) {}
+    }
+
+    type& q = *queue;
+    if (state.thread_index == 0) {
+        PREPARE_THREAD(pair.producer_affinity);
+        const double interval = tsc_ticks_per_ns() * 1000.0 / double(state.range(1));
+        uint64_t sent = 0;
+        uint64_t start = 0;
+        for (auto _ : state) {
+            if (sent == 0)
+                start = read_tsc();
+            for (int i = 0; i < MessagesPerIteration; i += 1) {
+                const timestamp due = start + uint64_t(double(sent) * interval);
+                while (read_tsc() < due) {}
+                while (q.push(due) == false) {}
+                sent += 1;
+            }
+        }
+    } else if (state.thread_index == 1) {
+        PREPARE_THREAD(pair.consumer_affinity);
+        latency_histogram<> histogram;
+        for (auto _ : state) {
+            int counter = MessagesPerIteration;
+            while (counter > 0) {
+                timestamp due;
+                if (q.pop(due)) {
+                    auto now = read_tsc();
+                    histogram.record(now > due ? now - due : 0);
+                    counter -= 1;
+                }
+            }
+        }
+        report_latency(state, histogram);
+
+        if constexpr (has_is_empty<type>::value) {
+            if (q.is_empty() == false) {
+                state.SkipWithError("Not Empty after test");
+            }
+        }
+
+        delete queue;
+        queue = nullptr;
+    }
+    state.SetItemsProcessed(state.iterations() * MessagesPerIteration);
+}
+
+// The last version of the Lamport, MCRingBuffer, GFF and Chunked families,
+// which all copy elements in and pass them to a callback on the way out.
+template<template<typename, std::size_t> class queue>
+struct open_loop_adapter : queue<timestamp, QueueCapacity> {
+    bool push(timestamp t) {
+        return this->Enqueue(t) != 0;
+    }
+
+    bool pop(timestamp& t) {
+        return this->Dequeue([&t](timestamp&& e) { t = e; }) != 0;
+    }
+};
+
+// FastForward passes pointers. The timestamps live in slots that are only
+// reused after 2 * QueueCapacity messages, by then the consumer has read them.
+struct fastforward_open_loop_adapter : FastForward6<timestamp, QueueCapacity> {
+    bool push(timestamp t) {
+        auto& slot = _slots[_next];
+        slot = t;
+        if (Enqueue(&slot) == 0)
+            return false;
+        _next = (_next + 1) % _slots.size();
+        return true;
+    }
+
+    bool pop(timestamp& t) {
+        timestamp* out;
+        if (Dequeue(out) == 0)
+            return false;
+        t = *out;
+        return true;
+    }
+
+private:
+    alignas(128) std::array<timestamp, 2 * QueueCapacity> _slots{};
+    size_t _next = 0;
+};
+
+struct spsc_queue_open_loop_adapter : spsc_queue<timestamp, ctu::log2_v<QueueCapacity>> {
+    bool push(timestamp t) {
+        return this->produce(t);
+    }
+
+    bool pop(timestamp& t) {
+        return this->consume([&t](timestamp* e) {
+            t = *e;
+            return true;
+        });
+    }
+};
+
+using deaod_spsc_queue_open_loop_adapter = deaod::spsc_queue<timestamp, QueueCapacity>;
+using spsc_queue_chunked_ptr_open_loop_adapter = spsc_queue_chunked_ptr<timestamp, QueueCapacity>;
+
+BENCHMARK_TEMPLATE(OpenLoop, open_loop_adapter<LamportQueue9>)->Apply(configure_open_loop);
+BENCHMARK_TEMPLATE(OpenLoop, fastforward_open_loop_adapter)->Apply(configure_open_loop);
+BENCHMARK_TEMPLATE(OpenLoop, open_loop_adapter<MCRingBuffer7>)->Apply(configure_open_loop);
+BENCHMARK_TEMPLATE(OpenLoop, open_loop_adapter<GFFQueue5>)->Apply(configure_open_loop);
+BENCHMARK_TEMPLATE(OpenLoop, open_loop_adapter<ChunkedQueue7>)->Apply(configure_open_loop);
+BENCHMARK_TEMPLATE(OpenLoop, deaod_spsc_queue_open_loop_adapter)->Apply(configure_open_loop);
+BENCHMARK_TEMPLATE(OpenLoop, spsc_queue_open_loop_adapter)->Apply(configure_open_loop);
+BENCHMARK_TEMPLATE(OpenLoop, spsc_queue_chunked_ptr_open_loop_adapter)->Apply(configure_open_loop);
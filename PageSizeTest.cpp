@@ -0,0 +1,109 @@
+#include "spsc_queue_heap.hpp"
+#include "spsc_ring_buffer_heap.hpp"
+#include "page_alloc.hpp"
+#include "BenchmarkSupport.hpp"
+#include "DummyContainer.hpp"
+#include "Platform.hpp"
+#include <cstring>
+#include <new>
+
+using record = DummyContainer<64>;
+
+// Buffers of 1M to 1G bytes, backed by 4K pages, transparent huge pages, and
+// explicit 2M and 1G huge pages. The pages are placed on the NUMA node of the
+// consumer. Runs are skipped if the machine does not provide a page size.
+template<typename type>
+static void PageSizePushPop(benchmark::State& state) {
+    static std::atomic<type*> queue = nullptr;
+    static std::atomic<bool> failed = false;
+
+    const core_pair& pair = core_pair_of(state);
+    state.SetLabel(pair.name);
+
+    // both threads come to the same conclusion, so neither waits for the other
+    if (type::allocator::available() == false) {
+        state.SkipWithError("Page size not available");
+        return;
+    }
+
+    // the pool of huge pages may still be too small for the whole buffer
+    if (state.thread_index == 0) {
+        numa_target_node() = numa_node_of(pair.consumer_affinity);
+        try {
+            queue = new type{};
+        } catch (const std::bad_alloc&) {
+            failed = true;
+        }
+        numa_target_node() = -1;
+    } else {
+        while (queue.load(std::memory_order_relaxed) == nullptr && failed.load(std::memory_order_relaxed) == false) {}
+    }
+
+    if (queue.load() == nullptr) {
+        state.SkipWithError("Allocation failed");
+        if (state.thread_index == 1) {
+            failed = false;
+        }
+        return;
+    }
+
+    type& q = *queue;
+    if (state.thread_index == 0) {
+        PREPARE_THREAD(pair.producer_affinity);
+        record elem{};
+        for (auto _ : state) {
+            int counter = 10000;
+            while (counter > 0) {
+                counter -= int(q.push(elem));
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * 10000);
+        state.SetBytesProcessed(state.iterations() * 10000 * sizeof(record));
+    } else if (state.thread_index == 1) {
+        PREPARE_THREAD(pair.consumer_affinity);
+        record elem{};
+        for (auto _ : state) {
+            int counter = 10000;
+            while (counter > 0) {
+                counter -= int(q.pop(elem));
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * 10000);
+        state.SetBytesProcessed(state.iterations() * 10000 * sizeof(record));
+
+        if (q.is_empty() == false) {
+            state.SkipWithError("Not Empty after test");
+        }
+
+        delete queue;
+        queue = nullptr;
+    }
+}
+
+template<typename allocator, int size_log2>
+struct spsc_ring_buffer_heap_paged : spsc_ring_buffer_heap<size_log2, 3, ptrdiff_t, 7, allocator> {
+    bool push(const record& r) {
+        return this->produce(sizeof(r), [&r](void* ptr) {
+            memcpy(ptr, &r, sizeof(r));
+            return true;
+        });
+    }
+
+    bool pop(record& r) {
+        return this->consume([&r](const void* ptr, ptrdiff_t) {
+            memcpy(&r, ptr, sizeof(r));
+            return true;
+        });
+    }
+};
+
+template<typename _allocator, int size_log2>
+struct spsc_queue_chunked_ptr_heap_paged : spsc_queue_chunked_ptr_heap<record, (1 << 15), _allocator> {
+    using allocator = _allocator;
+
+    spsc_queue_chunked_ptr_heap_paged() :
+        spsc_queue_chunked_ptr_heap<record, (1 << 15), _allocator>((size_t(1) << size_log2) / sizeof(record)) {}
+};
+
+PAGE_SIZE_BENCH(PageSizePushPop, spsc_ring_buffer_heap_paged);
+PAGE_SIZE_BENCH(PageSizePushPop, spsc_queue_chunked_ptr_heap_paged);
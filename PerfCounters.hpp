@@ -0,0 +1,196 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+// Hardware performance counters of the calling thread, using perf_event_open.
+// Counting starts with the first call of start() and stops with stop() or on
+// destruction. Calling start() at the top of the benchmark loop leaves out
+// the setup and the start barrier, but the barrier after the last iteration
+// is still counted.
+// Only user space is counted, which is what perf_event_paranoid 2 (the common
+// default) allows without privileges.
+//
+// Each counter is opened on its own, so a counter the CPU or the kernel does
+// not support is simply missing (available() is false) instead of taking all
+// others with it. If the kernel multiplexes counters, values are scaled by the
+// fraction of time they were actually counting, a counter that never got a
+// hardware counter has no value. In a container without
+// perf_event_open no counter is available, which is reported once on stderr.
+//
+// HITM (loads that hit a modified line in another core's cache) has no generic
+// event. Set RBB_PERF_HITM to the raw event for the CPU, eg. 0x04d2 for
+// MEM_LOAD_L3_HIT_RETIRED.XSNP_HITM on Skylake, to count it.
+struct perf_counters {
+    enum counter {
+        cycles,
+        instructions,
+        l1d_misses,
+        llc_misses,
+        branch_misses,
+        hitm,
+        counter_count
+    };
+
+    static const char* name_of(int c) noexcept {
+        static const char* const names[counter_count] = {
+            "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses", "hitm"
+        };
+        return names[c];
+    }
+
+    perf_counters() noexcept {
+        _fds.fill(-1);
+#if defined(__linux__)
+        int error = 0;
+        for (int c = 0; c < counter_count; c += 1) {
+            perf_event_attr attr;
+            if (describe(counter(c), attr) == false)
+                continue;
+
+            _fds[c] = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+            if (_fds[c] < 0 && error == 0) {
+                error = errno;
+            }
+        }
+
+        if (available(cycles) == false) {
+            static std::atomic<bool> reported = false;
+            if (reported.exchange(true) == false) {
+                fprintf(stderr, "perf counters unavailable: %s\n", strerror(error));
+            }
+        }
+#endif
+    }
+
+    perf_counters(const perf_counters&) = delete;
+    perf_counters& operator=(const perf_counters&) = delete;
+
+    ~perf_counters() {
+#if defined(__linux__)
+        for (int fd : _fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+#endif
+    }
+
+    // only the first call starts counting, later ones return immediately
+    void start() noexcept {
+        if (_started)
+            return;
+
+        _started = true;
+#if defined(__linux__)
+        for (int fd : _fds) {
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+
+    void stop() noexcept {
+#if defined(__linux__)
+        for (int fd : _fds) {
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            }
+        }
+#endif
+    }
+
+    bool available(counter c) const noexcept {
+        return _fds[c] >= 0;
+    }
+
+    // counted events since start(), false for unavailable counters and for
+    // counters that were never scheduled, eg. because others took all
+    // hardware counters
+    bool read(counter c, uint64_t& result) const noexcept {
+#if defined(__linux__)
+        if (_fds[c] < 0)
+            return false;
+
+        uint64_t values[3] = {};
+        if (::read(_fds[c], values, sizeof(values)) != ssize_t(sizeof(values)) || values[2] == 0)
+            return false;
+        if (values[2] == values[1]) {
+            result = values[0];
+        } else {
+            result = uint64_t(double(values[0]) * double(values[1]) / double(values[2]));
+        }
+        return true;
+#else
+        (void)c;
+        (void)result;
+        return false;
+#endif
+    }
+
+
+private:
+#if defined(__linux__)
+    static bool describe(counter c, perf_event_attr& attr) noexcept {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        switch (c) {
+        case cycles:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            return true;
+        case instructions:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            return true;
+        case l1d_misses:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D
+                | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            return true;
+        case llc_misses:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            return true;
+        case branch_misses:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            return true;
+        case hitm: {
+            const char* raw = getenv("RBB_PERF_HITM");
+            if (raw == nullptr || *raw == '\0')
+                return false;
+            attr.type = PERF_TYPE_RAW;
+            attr.config = strtoull(raw, nullptr, 0);
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+#endif
+
+    std::array<int, counter_count> _fds;
+    bool _started = false;
+};
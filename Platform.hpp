@@ -1,7 +1,13 @@
 #pragma once
 
+#include <chrono>
 #include <cstdint>
 
+// Linux only: additionally request SCHED_FIFO for benchmark threads.
+// Requires CAP_SYS_NICE (or a suitable RLIMIT_RTPRIO), otherwise threads
+// silently keep their normal scheduling policy.
+constexpr bool WANT_REALTIME_SCHEDULING = false;
+
 #if defined(_WIN32)
 #include <Windows.h>
 #define PREPARE_THREAD(affinity) do {                                  \
@@ -13,10 +19,124 @@
     SetPriorityClass(GetCurrentProcess(), REALTIME_PRIORITY_CLASS); \
 } while(0)
 
+// CPU time consumed by the calling thread, in nanoseconds.
+inline int64_t thread_cpu_time_ns() {
+    FILETIME creation, exit, kernel, user;
+    GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+    auto to_ticks = [](FILETIME t) { return (int64_t(t.dwHighDateTime) << 32) | t.dwLowDateTime; };
+    return (to_ticks(kernel) + to_ticks(user)) * 100;
+}
+
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// All calls below may fail due to missing privileges (containers, non-root
+// users). In that case the thread/process simply keeps its current settings.
+inline void prepare_thread_linux(uint64_t affinity) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < 64; cpu += 1) {
+        if (affinity & (uint64_t(1) << cpu)) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+    if (WANT_REALTIME_SCHEDULING) {
+        sched_param param{};
+        param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+        pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    }
+}
+
+inline bool has_ipc_lock_capability() {
+    FILE* status = fopen("/proc/self/status", "r");
+    if (status == nullptr)
+        return false;
+
+    uint64_t caps = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), status)) {
+        if (strncmp(line, "CapEff:", 7) == 0) {
+            caps = strtoull(line + 7, nullptr, 16);
+            break;
+        }
+    }
+    fclose(status);
+
+    const int cap_ipc_lock = 14;
+    return (caps >> cap_ipc_lock) & 1;
+}
+
+inline void prepare_process_linux() {
+    // With MCL_FUTURE every later allocation that would exceed RLIMIT_MEMLOCK
+    // fails, which breaks the large queue configurations. Only lock memory if
+    // that cannot happen.
+    rlimit limit{};
+    bool unlimited = getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur == RLIM_INFINITY;
+    if (unlimited || has_ipc_lock_capability()) {
+        mlockall(MCL_CURRENT | MCL_FUTURE);
+    }
+}
+
+#define PREPARE_THREAD(affinity) do { prepare_thread_linux(affinity); } while(0)
+#define PREPARE_PROCESS() do { prepare_process_linux(); } while(0)
+
+// CPU time consumed by the calling thread, in nanoseconds.
+inline int64_t thread_cpu_time_ns() {
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
 #else
+#include <ctime>
 #define PREPARE_THREAD(affinity) do { } while(0)
 #define PREPARE_PROCESS() do { } while(0)
+
+// Falls back to the CPU time of the whole process.
+inline int64_t thread_cpu_time_ns() {
+    return int64_t(std::clock()) * (1000000000 / CLOCKS_PER_SEC);
+}
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
 #endif
 
+inline uint64_t read_tsc() {
+    return __rdtsc();
+}
+#else
+// No TSC available, fall back to nanoseconds since an arbitrary epoch.
+inline uint64_t read_tsc() {
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+#endif
+
+// read_tsc() ticks per nanosecond, measured once against steady_clock.
+inline double tsc_ticks_per_ns() {
+    static const double ticks_per_ns = [] {
+        auto start = std::chrono::steady_clock::now();
+        auto tsc_start = read_tsc();
+        while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(20)) {}
+        auto tsc_end = read_tsc();
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        return double(tsc_end - tsc_start) / double(elapsed.count());
+    }();
+    return ticks_per_ns;
+}
+
 constexpr uint64_t Thread1Affinity = 1 << 0;
 constexpr uint64_t Thread2Affinity = 1 << 2;
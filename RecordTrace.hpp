@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// Recorded arrivals of records, as written by tools/trace.py. The file starts
+// with a 16 byte header: the magic "RBBTRACE", the format version and the
+// number of entries, both uint32_t. One trace_entry per record follows. All
+// integers are little endian.
+struct trace_entry {
+    uint32_t delta_ns; // since the previous record, 0 for the first
+    uint32_t length;   // in bytes
+};
+
+static_assert(sizeof(trace_entry) == 8);
+
+constexpr char TraceMagic[8] = { 'R', 'B', 'B', 'T', 'R', 'A', 'C', 'E' };
+constexpr uint32_t TraceVersion = 1;
+
+// Reports what is wrong with the file on stderr and returns false if it
+// cannot be read.
+inline bool load_trace(const char* path, std::vector<trace_entry>& entries) {
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        fprintf(stderr, "cannot read trace %s\n", path);
+        return false;
+    }
+
+    char magic[sizeof(TraceMagic)];
+    uint32_t version = 0;
+    uint32_t count = 0;
+    bool ok = fread(magic, sizeof(magic), 1, file) == 1
+        && fread(&version, sizeof(version), 1, file) == 1
+        && fread(&count, sizeof(count), 1, file) == 1;
+    if (ok == false || memcmp(magic, TraceMagic, sizeof(magic)) != 0) {
+        fprintf(stderr, "%s is not a trace\n", path);
+        ok = false;
+    } else if (version != TraceVersion) {
+        fprintf(stderr, "%s: trace version %u, expected %u\n", path, version, TraceVersion);
+        ok = false;
+    } else {
+        entries.resize(count);
+        ok = count == 0 || fread(entries.data(), sizeof(trace_entry), count, file) == count;
+        if (ok == false) {
+            fprintf(stderr, "%s: truncated, expected %u entries\n", path, count);
+        }
+    }
+
+    fclose(file);
+    return ok && count > 0;
+}
+
+// The trace named by RBB_TRACE, loaded on first use. nullptr if the variable
+// is not set or the file is not a valid trace.
+inline const std::vector<trace_entry>* environment_trace() {
+    static const auto* trace = []() -> std::vector<trace_entry>* {
+        const char* path = getenv("RBB_TRACE");
+        if (path == nullptr || *path == '\0')
+            return nullptr;
+
+        static std::vector<trace_entry> entries;
+        if (load_trace(path, entries) == false)
+            return nullptr;
+        return &entries;
+    }();
+    return trace;
+}
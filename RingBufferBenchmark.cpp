@@ -1,6 +1,8 @@
 #include <benchmark/benchmark.h>
 #include "ce_queue.hpp"
 #include "spsc_queue.hpp"
+#include "spsc_queue_heap.hpp"
+#include "spsc_queue_unbounded.hpp"
 #include "spsc_queue_release.hpp"
 #include "spsc_ring_buffer.hpp"
 #include "spsc_ring_buffer_cached.hpp"
@@ -15,18 +17,22 @@
 #include "DummyContainer.hpp"
 #include "Platform.hpp"
 #include "BenchmarkSupport.hpp"
+#include "compile_time_utilities.hpp"
+#include <algorithm>
 #include <chrono>
 #include <thread>
 #include <new>
 #include <array>
 #include <memory>
-
-constexpr bool WANT_BACKGROUND_LOAD = false;
+#include <vector>
 
 template<typename type>
 static void QueuePushPop(benchmark::State& state) {
     static std::atomic<type*> queue = nullptr;
 
+    const core_pair& pair = core_pair_of(state);
+    state.SetLabel(pair.name);
+
     if (state.thread_index == 0) {
         queue = new type{};
     } else {
@@ -35,25 +41,31 @@ static void QueuePushPop(benchmark::State& state) {
 
     type& q = *queue;
     if (state.thread_index == 0) {
-        PREPARE_THREAD(Thread1Affinity);
+        PREPARE_THREAD(pair.producer_affinity);
         typename type::value_type elem{};
+        perf_counters counters;
         for (auto _ : state) {
+            counters.start();
             int counter = 10000;
             while (counter > 0) {
                 counter -= int(q.push(elem));
             }
         }
+        report_perf_counters(state, counters, "producer_", state.iterations() * 10000);
         state.SetItemsProcessed(state.iterations() * 10000);
         state.SetBytesProcessed(state.iterations() * 10000 * sizeof(typename type::value_type));
     } else if (state.thread_index == 1) {
-        PREPARE_THREAD(Thread2Affinity);
+        PREPARE_THREAD(pair.consumer_affinity);
         typename type::value_type elem{};
+        perf_counters counters;
         for (auto _ : state) {
+            counters.start();
             int counter = 10000;
             while (counter > 0) {
                 counter -= int(q.pop(elem));
             }
         }
+        report_perf_counters(state, counters, "consumer_", state.iterations() * 10000);
         state.SetItemsProcessed(state.iterations() * 10000);
         state.SetBytesProcessed(state.iterations() * 10000 * sizeof(typename type::value_type));
 
@@ -64,7 +76,7 @@ static void QueuePushPop(benchmark::State& state) {
         delete queue;
         queue = nullptr;
     } else {
-        PREPARE_THREAD(Thread2Affinity);
+        PREPARE_THREAD(pair.consumer_affinity);
         while (queue.load() != nullptr) {}
     }
 }
@@ -73,6 +85,9 @@ template<typename type>
 static void QueueEmplacePop(benchmark::State& state) {
     static std::atomic<type*> queue = nullptr;
 
+    const core_pair& pair = core_pair_of(state);
+    state.SetLabel(pair.name);
+
     if (state.thread_index == 0) {
         auto p = new type{};
         queue = p;
@@ -82,7 +97,7 @@ static void QueueEmplacePop(benchmark::State& state) {
 
     type& q = *queue;
     if (state.thread_index == 0) {
-        PREPARE_THREAD(Thread1Affinity);
+        PREPARE_THREAD(pair.producer_affinity);
         for (auto _ : state) {
             int counter = 10000;
             while (counter > 0) {
@@ -92,7 +107,7 @@ static void QueueEmplacePop(benchmark::State& state) {
         state.SetItemsProcessed(state.iterations() * 10000);
         state.SetBytesProcessed(state.iterations() * 10000 * sizeof(typename type::value_type));
     } else if (state.thread_index == 1) {
-        PREPARE_THREAD(Thread2Affinity);
+        PREPARE_THREAD(pair.consumer_affinity);
         typename type::value_type elem{};
         for (auto _ : state) {
             int counter = 10000;
@@ -112,7 +127,7 @@ static void QueueEmplacePop(benchmark::State& state) {
         delete queue;
         queue = nullptr;
     } else {
-        PREPARE_THREAD(Thread2Affinity);
+        PREPARE_THREAD(pair.consumer_affinity);
         while (queue.load() != nullptr) {}
     }
 }
@@ -121,6 +136,9 @@ template<typename type>
 static void QueueEmplaceConsume(benchmark::State& state) {
     static std::atomic<type*> queue = nullptr;
 
+    const core_pair& pair = core_pair_of(state);
+    state.SetLabel(pair.name);
+
     if (state.thread_index == 0) {
         queue = new type{};
     } else {
@@ -129,7 +147,7 @@ static void QueueEmplaceConsume(benchmark::State& state) {
 
     type& q = *queue;
     if (state.thread_index == 0) {
-        PREPARE_THREAD(Thread1Affinity);
+        PREPARE_THREAD(pair.producer_affinity);
         for (auto _ : state) {
             int counter = 10000;
             while (counter > 0) {
@@ -139,7 +157,7 @@ static void QueueEmplaceConsume(benchmark::State& state) {
         state.SetItemsProcessed(state.iterations() * 10000);
         state.SetBytesProcessed(state.iterations() * 10000 * sizeof(typename type::value_type));
     } else if (state.thread_index == 1) {
-        PREPARE_THREAD(Thread2Affinity);
+        PREPARE_THREAD(pair.consumer_affinity);
         for (auto _ : state) {
             int counter = 10000;
             while (counter > 0) {
@@ -156,7 +174,7 @@ static void QueueEmplaceConsume(benchmark::State& state) {
         delete queue;
         queue = nullptr;
     } else {
-        PREPARE_THREAD(Thread2Affinity);
+        PREPARE_THREAD(pair.consumer_affinity);
         while (queue.load() != nullptr) {}
     }
 }
@@ -165,6 +183,9 @@ template<typename type>
 static void QueueEmplaceDiscard(benchmark::State& state) {
     static std::atomic<type*> queue = nullptr;
 
+    const core_pair& pair = core_pair_of(state);
+    state.SetLabel(pair.name);
+
     if (state.thread_index == 0) {
         type* p = new type{};
         while (p->emplace()) {}
@@ -175,7 +196,7 @@ static void QueueEmplaceDiscard(benchmark::State& state) {
 
     type& q = *queue;
     if (state.thread_index == 0) {
-        PREPARE_THREAD(Thread1Affinity);
+        PREPARE_THREAD(pair.producer_affinity);
         for (auto _ : state) {
             int counter = 10000;
             while (counter > 0) {
@@ -185,7 +206,7 @@ static void QueueEmplaceDiscard(benchmark::State& state) {
         state.SetItemsProcessed(state.iterations() * 10000);
         state.SetBytesProcessed(state.iterations() * 10000 * sizeof(typename type::value_type));
     } else if (state.thread_index == 1) {
-        PREPARE_THREAD(Thread2Affinity);
+        PREPARE_THREAD(pair.consumer_affinity);
         for (auto _ : state) {
             int counter = 10000;
             while (counter > 0) {
@@ -210,7 +231,7 @@ static void QueueEmplaceDiscard(benchmark::State& state) {
         delete queue;
         queue = nullptr;
     } else {
-        PREPARE_THREAD(Thread2Affinity);
+        PREPARE_THREAD(pair.consumer_affinity);
         while (queue.load() == nullptr) {}
         for (auto _ : state) {
         }
@@ -218,6 +239,63 @@ static void QueueEmplaceDiscard(benchmark::State& state) {
     }
 }
 
+template<typename type>
+static void QueueBatchProduceConsume(benchmark::State& state) {
+    static std::atomic<type*> queue = nullptr;
+
+    const core_pair& pair = core_pair_of(state);
+    state.SetLabel(pair.name);
+    const auto batch = int(state.range(1));
+
+    if (state.thread_index == 0) {
+        queue = new type{};
+    } else {
+        while (queue.load(std::memory_order_relaxed) == nullptr) {}
+    }
+
+    type& q = *queue;
+    if (state.thread_index == 0) {
+        PREPARE_THREAD(pair.producer_affinity);
+        std::vector<typename type::value_type> elems(batch);
+        for (auto _ : state) {
+            int counter = 10000;
+            while (counter > 0) {
+                counter -= int(q.produce_n(elems.begin(), elems.begin() + std::min(batch, counter)));
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * 10000);
+        state.SetBytesProcessed(state.iterations() * 10000 * sizeof(typename type::value_type));
+    } else if (state.thread_index == 1) {
+        PREPARE_THREAD(pair.consumer_affinity);
+        for (auto _ : state) {
+            int counter = 10000;
+            while (counter > 0) {
+                counter -= int(q.consume_n([](typename type::value_type*) { return true; }, size_t(std::min(batch, counter))));
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * 10000);
+        state.SetBytesProcessed(state.iterations() * 10000 * sizeof(typename type::value_type));
+
+        if (q.is_empty() == false) {
+            state.SkipWithError("Not Empty after test");
+        }
+
+        delete queue;
+        queue = nullptr;
+    }
+}
+
+// Round trip time, see ping_pong.
+template<typename type>
+static void QueuePingPong(benchmark::State& state) {
+    ping_pong<type>(state,
+        [](type& q) { return q.push(typename type::value_type{}); },
+        [](type& q) {
+            typename type::value_type elem;
+            return q.pop(elem);
+        });
+}
+
 template<typename T, size_t S>
 struct folly_pcq_adapter : folly::ProducerConsumerQueue<T> {
 
@@ -328,6 +406,87 @@ struct moodycamel_adapter : moodycamel::ReaderWriterQueue<T> {
     }
 };
 
+// spsc_queue_cached takes the log2 of its size, round down to the nearest
+// power of two.
+template<typename T, size_t S>
+struct spsc_queue_cached_adapter : spsc_queue_cached<T, ctu::log2_v<S>> {
+    bool push(const T& e) {
+        return this->produce(e);
+    }
+
+    bool pop(T& e) {
+        return this->consume([&e](T* elem) {
+            e = std::move(*elem);
+            return true;
+        });
+    }
+};
+
+// spsc_queue takes the log2 of its size, round down to the nearest power of
+// two. spsc_queue_heap_adapter uses the same capacity.
+template<typename T, size_t S>
+struct spsc_queue_adapter : spsc_queue<T, ctu::log2_v<S>> {
+    bool push(const T& e) {
+        return this->produce(e);
+    }
+
+    bool pop(T& e) {
+        return this->consume([&e](T* elem) {
+            e = std::move(*elem);
+            return true;
+        });
+    }
+};
+
+template<typename T, size_t S>
+struct spsc_queue_heap_adapter : spsc_queue_heap<T> {
+    spsc_queue_heap_adapter() : spsc_queue_heap<T>(size_t(1) << ctu::log2_v<S>) {}
+
+    bool push(const T& e) {
+        return this->produce(e);
+    }
+
+    bool pop(T& e) {
+        return this->consume([&e](T* elem) {
+            e = std::move(*elem);
+            return true;
+        });
+    }
+};
+
+template<typename T, size_t S>
+struct spsc_queue_chunked_ptr_heap_adapter : spsc_queue_chunked_ptr_heap<T> {
+    spsc_queue_chunked_ptr_heap_adapter() : spsc_queue_chunked_ptr_heap<T>(S) {}
+};
+
+// The unbounded queues ignore S. spsc_queue_chunked_unbounded reserves enough
+// chunks for S elements, so it only allocates once it outgrows a bounded queue
+// of the same size.
+template<typename T, size_t S>
+struct folly_uspsc_adapter : folly::USPSCQueue<T, false> {
+    using value_type = T;
+
+    bool push(const T& e) {
+        this->enqueue(e);
+        return true;
+    }
+
+    bool pop(T& e) {
+        return this->try_dequeue(e);
+    }
+
+    bool is_empty() {
+        return this->empty();
+    }
+};
+
+template<typename T, size_t S>
+struct spsc_queue_chunked_unbounded_adapter : spsc_queue_chunked_unbounded<T> {
+    using base_type = spsc_queue_chunked_unbounded<T>;
+
+    spsc_queue_chunked_unbounded_adapter() : base_type((S + base_type::chunk_size - 1) / base_type::chunk_size) {}
+};
+
 //QUEUE_BENCH(QueuePushPop, folly_pcq_adapter);
 //QUEUE_BENCH(QueuePushPop, boost_adapter);
 //QUEUE_BENCH(QueuePushPop, deaod::spsc_queue);
@@ -349,19 +508,26 @@ struct moodycamel_adapter : moodycamel::ReaderWriterQueue<T> {
 //QUEUE_BENCH(QueueEmplaceDiscard, deaod::spsc_queue);
 //QUEUE_BENCH(QueueEmplaceDiscard, moodycamel_adapter);
 
-int main(int argc, char** argv) {
-    PREPARE_PROCESS();
-
-    std::atomic_bool b{ WANT_BACKGROUND_LOAD == false };
-    std::thread load{ [&b] {
-        PREPARE_THREAD(Thread2Affinity);
-        while (b.load() == false) {}
-    } };
-
-    ::benchmark::Initialize(&argc, argv);
-    if (::benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
-    ::benchmark::RunSpecifiedBenchmarks();
-    
-    b.store(true);
-    load.join();
-}
+QUEUE_BENCH_CONFIGURED(QueueBatchProduceConsume, spsc_queue_cached_adapter, configure_batch_queue);
+
+// inline storage against runtime capacity on the heap
+QUEUE_BENCH(QueuePushPop, spsc_queue_adapter);
+QUEUE_BENCH(QueuePushPop, spsc_queue_heap_adapter);
+QUEUE_BENCH(QueuePushPop, spsc_queue_chunked_ptr);
+QUEUE_BENCH(QueuePushPop, spsc_queue_chunked_ptr_heap_adapter);
+
+// unbounded queues: folly ignores the capacity, so it runs once per element
+// size. The reserve of spsc_queue_chunked_unbounded follows it, a few sizes
+// show when the reserve stops covering the elements in flight.
+QUEUE_BENCH_FOR_CAPACITY(QueuePushPop, folly_uspsc_adapter, 12);
+QUEUE_BENCH_FOR_CAPACITY(QueuePushPop, spsc_queue_chunked_unbounded_adapter, 12);
+QUEUE_BENCH_FOR_CAPACITY(QueuePushPop, spsc_queue_chunked_unbounded_adapter, 16);
+QUEUE_BENCH_FOR_CAPACITY(QueuePushPop, spsc_queue_chunked_unbounded_adapter, 20);
+QUEUE_BENCH_FOR_CAPACITY(QueuePushPop, spsc_queue_chunked_unbounded_adapter, 24);
+
+PING_PONG_BENCH(QueuePingPong, folly_pcq_adapter);
+PING_PONG_BENCH(QueuePingPong, boost_adapter);
+PING_PONG_BENCH(QueuePingPong, deaod::spsc_queue);
+PING_PONG_BENCH(QueuePingPong, spsc_queue_chunked_ptr);
+PING_PONG_BENCH(QueuePingPong, moodycamel_adapter);
+PING_PONG_BENCH(QueuePingPong, spsc_queue_cached_adapter);
@@ -0,0 +1,265 @@
+#include "spsc_ring_buffer.hpp"
+#include "spsc_ring_buffer_cached.hpp"
+#include "spsc_ring_buffer_chunked.hpp"
+#include "spsc_ring_buffer_heap.hpp"
+#include "spsc_ring_buffer_lossy.hpp"
+#include "spsc_ring_buffer_mirrored.hpp"
+#include "BenchmarkSupport.hpp"
+#include "Platform.hpp"
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+// Like configure_queue, with the maximum record length in bytes as second
+// argument. Record lengths are spread evenly between 8 and the maximum, so
+// larger maximums hit the end of the buffer more often.
+inline void configure_record_length_queue(benchmark::internal::Benchmark* bench) {
+    bench->Threads(2);
+    bench->Repetitions(repetitions(20));
+    bench->ArgNames({ "pair", "max_length" });
+    for (size_t i = 0; i < core_pairs().size(); i += 1) {
+        if (selected_benchmarks().selects_pair(core_pairs()[i]) == false)
+            continue;
+        for (int64_t max_length = 64; max_length <= 4096; max_length *= 4) {
+            bench->Args({ int64_t(i), max_length });
+        }
+    }
+}
+
+// Like configure_queue, with the publish interval of drain() as second
+// argument, 0 publishing the consume position only once per drain.
+inline void configure_drain_queue(benchmark::internal::Benchmark* bench) {
+    bench->Threads(2);
+    bench->Repetitions(repetitions(20));
+    bench->ArgNames({ "pair", "publish_interval" });
+    for (size_t i = 0; i < core_pairs().size(); i += 1) {
+        if (selected_benchmarks().selects_pair(core_pairs()[i]) == false)
+            continue;
+        for (int64_t interval : { 0, 1, 16, 256 }) {
+            bench->Args({ int64_t(i), interval });
+        }
+    }
+}
+
+constexpr int RecordsPerIteration = 10000;
+
+// Same sequence of lengths for every buffer, from a fixed xorshift seed.
+static std::array<size_t, 1024> record_lengths(size_t max_length) {
+    std::array<size_t, 1024> result;
+    uint32_t x = 2463534242u;
+    for (auto& length : result) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        length = 8 + x % (max_length - 7);
+    }
+    return result;
+}
+
+// The producer fills every record completely, the consumer copies it out, so
+// both sides touch all bytes of the record.
+template<typename type>
+static void RingBufferVariableLength(benchmark::State& state) {
+    static std::atomic<type*> queue = nullptr;
+
+    const core_pair& pair = core_pair_of(state);
+    state.SetLabel(pair.name);
+
+    if (state.thread_index == 0) {
+        queue = new type{};
+    } else {
+        while (queue.load(std::memory_order_relaxed) == nullptr) {}
+    }
+
+    type& q = *queue;
+    if (state.thread_index == 0) {
+        PREPARE_THREAD(pair.producer_affinity);
+        const auto lengths = record_lengths(size_t(state.range(1)));
+        size_t next = 0;
+        int64_t bytes = 0;
+        for (auto _ : state) {
+            int counter = RecordsPerIteration;
+            while (counter > 0) {
+                size_t length = lengths[next];
+                if (q.produce(length, [length](void* ptr) {
+                    memset(ptr, 0x5a, length);
+                    return true;
+                })) {
+                    next = (next + 1) % lengths.size();
+                    bytes += int64_t(length);
+                    counter -= 1;
+                }
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * RecordsPerIteration);
+        state.SetBytesProcessed(bytes);
+    } else if (state.thread_index == 1) {
+        PREPARE_THREAD(pair.consumer_affinity);
+        alignas(16) std::byte copy[4096];
+        for (auto _ : state) {
+            int counter = RecordsPerIteration;
+            while (counter > 0) {
+                counter -= int(q.consume([&copy](const void* ptr, ptrdiff_t length) {
+                    memcpy(copy, ptr, size_t(length));
+                    benchmark::DoNotOptimize(copy);
+                    return true;
+                }));
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * RecordsPerIteration);
+
+        if (q.is_empty() == false) {
+            state.SkipWithError("Not Empty after test");
+        }
+
+        delete queue;
+        queue = nullptr;
+    }
+}
+
+// The producer never waits, records the consumer cannot keep up with are
+// overwritten. The consumer counts consumed and dropped records towards its
+// quota, and reports the fraction it dropped.
+template<typename type>
+static void RingBufferLossy(benchmark::State& state) {
+    static std::atomic<type*> queue = nullptr;
+
+    const core_pair& pair = core_pair_of(state);
+    state.SetLabel(pair.name);
+
+    if (state.thread_index == 0) {
+        queue = new type{};
+    } else {
+        while (queue.load(std::memory_order_relaxed) == nullptr) {}
+    }
+
+    type& q = *queue;
+    if (state.thread_index == 0) {
+        PREPARE_THREAD(pair.producer_affinity);
+        const auto lengths = record_lengths(size_t(state.range(1)));
+        size_t next = 0;
+        int64_t bytes = 0;
+        for (auto _ : state) {
+            for (int i = 0; i < RecordsPerIteration; i += 1) {
+                size_t length = lengths[next];
+                q.produce(length, [length](void* ptr) {
+                    memset(ptr, 0x5a, length);
+                    return true;
+                });
+                next = (next + 1) % lengths.size();
+                bytes += int64_t(length);
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * RecordsPerIteration);
+        state.SetBytesProcessed(bytes);
+    } else if (state.thread_index == 1) {
+        PREPARE_THREAD(pair.consumer_affinity);
+        alignas(16) std::byte copy[4096];
+        uint64_t consumed = 0;
+        uint64_t quota = 0;
+        for (auto _ : state) {
+            quota += RecordsPerIteration;
+            while (consumed + q.dropped() < quota) {
+                consumed += uint64_t(q.consume([&copy](const void* ptr, ptrdiff_t length) {
+                    memcpy(copy, ptr, size_t(length));
+                    benchmark::DoNotOptimize(copy);
+                    return true;
+                }));
+            }
+        }
+        state.SetItemsProcessed(int64_t(consumed));
+        state.counters["dropped"] = quota > 0 ? double(q.dropped()) / double(quota) : 0.0;
+
+        if (q.is_empty() == false) {
+            state.SkipWithError("Not Empty after test");
+        }
+
+        delete queue;
+        queue = nullptr;
+    }
+}
+
+// The consumer takes everything available with one drain() call instead of a
+// consume() per record, records_per_drain shows how much each call found.
+template<typename type>
+static void RingBufferDrain(benchmark::State& state) {
+    static std::atomic<type*> queue = nullptr;
+
+    const core_pair& pair = core_pair_of(state);
+    state.SetLabel(pair.name);
+
+    if (state.thread_index == 0) {
+        queue = new type{};
+    } else {
+        while (queue.load(std::memory_order_relaxed) == nullptr) {}
+    }
+
+    type& q = *queue;
+    if (state.thread_index == 0) {
+        PREPARE_THREAD(pair.producer_affinity);
+        const auto lengths = record_lengths(256);
+        size_t next = 0;
+        int64_t bytes = 0;
+        for (auto _ : state) {
+            int counter = RecordsPerIteration;
+            while (counter > 0) {
+                size_t length = lengths[next];
+                if (q.produce(length, [length](void* ptr) {
+                    memset(ptr, 0x5a, length);
+                    return true;
+                })) {
+                    next = (next + 1) % lengths.size();
+                    bytes += int64_t(length);
+                    counter -= 1;
+                }
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * RecordsPerIteration);
+        state.SetBytesProcessed(bytes);
+    } else if (state.thread_index == 1) {
+        PREPARE_THREAD(pair.consumer_affinity);
+        const auto publish_interval = size_t(state.range(1));
+        alignas(16) std::byte copy[256];
+        uint64_t consumed = 0;
+        uint64_t quota = 0;
+        uint64_t drains = 0;
+        for (auto _ : state) {
+            quota += RecordsPerIteration;
+            while (consumed < quota) {
+                auto result = q.drain([&copy](const void* ptr, ptrdiff_t length) {
+                    memcpy(copy, ptr, size_t(length));
+                    benchmark::DoNotOptimize(copy);
+                    return true;
+                }, publish_interval);
+                consumed += result.records;
+                drains += uint64_t(result.records > 0);
+            }
+        }
+        state.SetItemsProcessed(int64_t(consumed));
+        state.counters["records_per_drain"] = drains > 0 ? double(consumed) / double(drains) : 0.0;
+
+        if (q.is_empty() == false) {
+            state.SkipWithError("Not Empty after test");
+        }
+
+        delete queue;
+        queue = nullptr;
+    }
+}
+
+BENCHMARK_TEMPLATE(RingBufferVariableLength, spsc_ring_buffer<16>)->Apply(configure_record_length_queue);
+BENCHMARK_TEMPLATE(RingBufferVariableLength, spsc_ring_buffer<16, 3, ptrdiff_t, 7, cached_index>)->Apply(configure_record_length_queue);
+BENCHMARK_TEMPLATE(RingBufferVariableLength, spsc_ring_buffer_masked<16>)->Apply(configure_record_length_queue);
+BENCHMARK_TEMPLATE(RingBufferVariableLength, spsc_ring_buffer_masked<16, 3, ptrdiff_t, 6, cached_index>)->Apply(configure_record_length_queue);
+BENCHMARK_TEMPLATE(RingBufferVariableLength, spsc_ring_buffer_heap<16>)->Apply(configure_record_length_queue);
+#if defined(__linux__)
+BENCHMARK_TEMPLATE(RingBufferVariableLength, spsc_ring_buffer_mirrored<16>)->Apply(configure_record_length_queue);
+#endif
+
+BENCHMARK_TEMPLATE(RingBufferLossy, spsc_ring_buffer_lossy<16>)->Apply(configure_record_length_queue);
+
+BENCHMARK_TEMPLATE(RingBufferDrain, spsc_ring_buffer<16>)->Apply(configure_drain_queue);
+BENCHMARK_TEMPLATE(RingBufferDrain, spsc_ring_buffer_cached<16>)->Apply(configure_drain_queue);
+BENCHMARK_TEMPLATE(RingBufferDrain, spsc_ring_buffer_heap<16>)->Apply(configure_drain_queue);
+BENCHMARK_TEMPLATE(RingBufferDrain, spsc_ring_buffer_chunked<20>)->Apply(configure_drain_queue);
@@ -0,0 +1,184 @@
+#include "spsc_queue_shm.hpp"
+#include "spsc_ring_buffer_shm.hpp"
+#include "shared_memory.hpp"
+#include "BenchmarkSupport.hpp"
+#include "DummyContainer.hpp"
+#include "Platform.hpp"
+#include <cstring>
+#include <new>
+#include <string>
+#include <system_error>
+
+#if defined(__linux__)
+#include <sys/wait.h>
+#include <unistd.h>
+
+using record = DummyContainer<64>;
+
+// Shared between both processes, in front of the queue.
+struct alignas(128) shm_control {
+    std::atomic<bool> attached{ false };
+    std::atomic<bool> stop{ false };
+};
+
+inline void configure_process_queue(benchmark::internal::Benchmark* bench) {
+    bench->Repetitions(repetitions(20));
+    apply_core_pairs(bench);
+}
+
+// The benchmark thread produces, a forked child process consumes. The child
+// maps the segment itself, so the queue is at a different address in each
+// process. Compare with the threaded benchmarks of spsc_queue and
+// spsc_ring_buffer_heap.
+template<typename type>
+static void ProcessPushPop(benchmark::State& state) {
+    const core_pair& pair = core_pair_of(state);
+    state.SetLabel(pair.name);
+
+    const std::string name = "/RingBufferBenchmark." + std::to_string(getpid());
+    const size_t queue_offset = sizeof(shm_control);
+
+    shared_memory_segment::remove(name.c_str());
+    shared_memory_segment segment;
+    try {
+        segment = shared_memory_segment::create(name.c_str(), queue_offset + type::required_size());
+    } catch (const std::system_error& e) {
+        shared_memory_segment::remove(name.c_str());
+        state.SkipWithError(e.what());
+        return;
+    }
+    auto control = new(segment.data()) shm_control{};
+    auto queue = type::create(static_cast<std::byte*>(segment.data()) + queue_offset, segment.size() - queue_offset);
+    if (queue == nullptr) {
+        shared_memory_segment::remove(name.c_str());
+        state.SkipWithError("Could not create queue");
+        return;
+    }
+
+    pid_t child = fork();
+    if (child == 0) {
+        PREPARE_THREAD(pair.consumer_affinity);
+        try {
+            auto own = shared_memory_segment::open(name.c_str());
+            auto own_control = std::launder(static_cast<shm_control*>(own.data()));
+            auto q = type::attach(static_cast<std::byte*>(own.data()) + queue_offset, own.size() - queue_offset);
+            if (q == nullptr)
+                _exit(1);
+            own_control->attached.store(true, std::memory_order_release);
+
+            record elem{};
+            while (true) {
+                if (type::pop(*q, elem) == false && own_control->stop.load(std::memory_order_acquire) && q->is_empty())
+                    break;
+            }
+        } catch (...) {
+            _exit(1);
+        }
+        _exit(0);
+    }
+
+    if (child < 0) {
+        shared_memory_segment::remove(name.c_str());
+        state.SkipWithError("fork failed");
+        return;
+    }
+
+    // the child exits without attaching if open or attach fail, the producer
+    // would then wait for space forever once the queue is full
+    int status = 0;
+    while (control->attached.load(std::memory_order_acquire) == false) {
+        if (waitpid(child, &status, WNOHANG) == child) {
+            shared_memory_segment::remove(name.c_str());
+            state.SkipWithError("Consumer process failed");
+            return;
+        }
+    }
+
+    PREPARE_THREAD(pair.producer_affinity);
+    record elem{};
+    for (auto _ : state) {
+        int counter = 10000;
+        while (counter > 0) {
+            counter -= int(type::push(*queue, elem));
+        }
+    }
+    control->stop.store(true, std::memory_order_release);
+
+    waitpid(child, &status, 0);
+    shared_memory_segment::remove(name.c_str());
+
+    if (WIFEXITED(status) == false || WEXITSTATUS(status) != 0) {
+        state.SkipWithError("Consumer process failed");
+    }
+
+    state.SetItemsProcessed(state.iterations() * 10000);
+    state.SetBytesProcessed(state.iterations() * 10000 * sizeof(record));
+}
+
+template<size_t S>
+struct spsc_queue_shm_adapter {
+    using queue_type = spsc_queue_shm<record>;
+
+    static size_t required_size() {
+        return queue_type::required_size(S);
+    }
+
+    static queue_type* create(void* memory, size_t size) {
+        return queue_type::create(memory, size, S);
+    }
+
+    static queue_type* attach(void* memory, size_t size) {
+        return queue_type::attach(memory, size);
+    }
+
+    static bool push(queue_type& q, const record& r) {
+        return q.push(r);
+    }
+
+    static bool pop(queue_type& q, record& r) {
+        return q.pop(r);
+    }
+};
+
+template<size_t S>
+struct spsc_ring_buffer_shm_adapter {
+    using queue_type = spsc_ring_buffer_shm<3>;
+
+    // as many bytes as spsc_queue_shm_adapter<S>, which holds S records
+    static const size_t size = S * sizeof(record);
+
+    static size_t required_size() {
+        return queue_type::required_size(size);
+    }
+
+    static queue_type* create(void* memory, size_t memory_size) {
+        return queue_type::create(memory, memory_size, size);
+    }
+
+    static queue_type* attach(void* memory, size_t memory_size) {
+        return queue_type::attach(memory, memory_size);
+    }
+
+    static bool push(queue_type& q, const record& r) {
+        return q.produce(sizeof(r), [&r](void* ptr) {
+            memcpy(ptr, &r, sizeof(r));
+            return true;
+        });
+    }
+
+    static bool pop(queue_type& q, record& r) {
+        return q.consume([&r](const void* ptr, ptrdiff_t) {
+            memcpy(&r, ptr, sizeof(r));
+            return true;
+        });
+    }
+};
+
+BENCHMARK_TEMPLATE(ProcessPushPop, spsc_queue_shm_adapter<(1 << 6)>)->Apply(configure_process_queue);
+BENCHMARK_TEMPLATE(ProcessPushPop, spsc_queue_shm_adapter<(1 << 10)>)->Apply(configure_process_queue);
+BENCHMARK_TEMPLATE(ProcessPushPop, spsc_queue_shm_adapter<(1 << 14)>)->Apply(configure_process_queue);
+BENCHMARK_TEMPLATE(ProcessPushPop, spsc_ring_buffer_shm_adapter<(1 << 6)>)->Apply(configure_process_queue);
+BENCHMARK_TEMPLATE(ProcessPushPop, spsc_ring_buffer_shm_adapter<(1 << 10)>)->Apply(configure_process_queue);
+BENCHMARK_TEMPLATE(ProcessPushPop, spsc_ring_buffer_shm_adapter<(1 << 14)>)->Apply(configure_process_queue);
+
+#endif
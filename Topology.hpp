@@ -0,0 +1,192 @@
+#pragma once
+
+#include "Platform.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// A producer/consumer core pair, classified by the closest level of the
+// memory hierarchy both cores share.
+struct core_pair {
+    const char* name;
+    uint64_t producer_affinity;
+    uint64_t consumer_affinity;
+};
+
+namespace topology_detail {
+
+// Parses the list format used throughout /sys/devices/system, eg. "0-3,8,10-11".
+// Only the first 64 CPUs are representable as an affinity mask.
+inline uint64_t parse_cpu_list(const std::string& list) {
+    uint64_t result = 0;
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t end = list.find(',', pos);
+        if (end == std::string::npos) end = list.size();
+
+        std::string range = list.substr(pos, end - pos);
+        size_t dash = range.find('-');
+        try {
+            int first = std::stoi(range.substr(0, dash));
+            int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last && cpu < 64; cpu += 1) {
+                result |= uint64_t(1) << cpu;
+            }
+        } catch (...) {}
+
+        pos = end + 1;
+    }
+    return result;
+}
+
+inline bool read_line(const std::string& path, std::string& line) {
+    std::ifstream file(path);
+    return bool(std::getline(file, line));
+}
+
+inline uint64_t read_cpu_list(const std::string& path) {
+    std::string line;
+    if (read_line(path, line) == false)
+        return 0;
+    return parse_cpu_list(line);
+}
+
+inline int lowest_cpu(uint64_t mask) {
+    for (int cpu = 0; cpu < 64; cpu += 1) {
+        if (mask & (uint64_t(1) << cpu))
+            return cpu;
+    }
+    return -1;
+}
+
+struct cpu_info {
+    uint64_t smt = 0;
+    uint64_t l2 = 0;
+    uint64_t llc = 0;
+    uint64_t node = 0;
+};
+
+inline cpu_info read_cpu_info(int cpu, const std::vector<uint64_t>& nodes) {
+    const std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+
+    cpu_info info;
+    info.smt = read_cpu_list(base + "/topology/thread_siblings_list");
+
+    int llc_level = 0;
+    for (int index = 0; ; index += 1) {
+        const std::string cache = base + "/cache/index" + std::to_string(index);
+        std::string level, type;
+        if (read_line(cache + "/level", level) == false)
+            break;
+        read_line(cache + "/type", type);
+        if (type == "Instruction")
+            continue;
+
+        uint64_t shared = read_cpu_list(cache + "/shared_cpu_list");
+        int lvl = std::stoi(level);
+        if (lvl == 2) {
+            info.l2 = shared;
+        }
+        if (lvl >= llc_level) {
+            llc_level = lvl;
+            info.llc = shared;
+        }
+    }
+
+    for (uint64_t node : nodes) {
+        if (node & (uint64_t(1) << cpu)) {
+            info.node = node;
+        }
+    }
+
+    return info;
+}
+
+inline std::vector<core_pair> discover_core_pairs() {
+    std::vector<core_pair> pairs;
+
+    uint64_t online = read_cpu_list("/sys/devices/system/cpu/online");
+    int producer = lowest_cpu(online);
+    if (producer < 0)
+        return pairs;
+
+    std::vector<uint64_t> nodes;
+    uint64_t online_nodes = read_cpu_list("/sys/devices/system/node/online");
+    for (int node = 0; node < 64; node += 1) {
+        if (online_nodes & (uint64_t(1) << node)) {
+            nodes.push_back(read_cpu_list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+        }
+    }
+
+    cpu_info p = read_cpu_info(producer, nodes);
+    uint64_t self = uint64_t(1) << producer;
+
+    // Candidates for each class exclude all CPUs of the closer classes, so
+    // eg. the "l2" pair never consists of SMT siblings.
+    struct pair_class {
+        const char* name;
+        uint64_t candidates;
+    };
+
+    uint64_t same_node = p.node ? p.node : online;
+    const pair_class classes[] = {
+        { "smt",       p.smt & ~self },
+        { "l2",        p.l2 & ~p.smt & ~self },
+        { "llc",       p.llc & ~p.l2 & ~p.smt & ~self },
+        { "cross_llc", same_node & ~p.llc & ~p.l2 & ~p.smt & ~self },
+        { "numa",      online & ~same_node },
+    };
+
+    for (const auto& c : classes) {
+        int consumer = lowest_cpu(c.candidates & online);
+        if (consumer >= 0) {
+            pairs.push_back(core_pair{ c.name, self, uint64_t(1) << consumer });
+        }
+    }
+
+    return pairs;
+}
+
+inline int node_of_cpu(int cpu) {
+    if (cpu < 0)
+        return -1;
+
+    uint64_t online_nodes = read_cpu_list("/sys/devices/system/node/online");
+    for (int node = 0; node < 64; node += 1) {
+        if ((online_nodes & (uint64_t(1) << node)) == 0)
+            continue;
+        if (read_cpu_list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist") & (uint64_t(1) << cpu))
+            return node;
+    }
+    return -1;
+}
+
+} // namespace topology_detail
+
+// Representative core pairs of this machine, at most one per class. Falls back
+// to Thread1Affinity/Thread2Affinity if the topology cannot be determined.
+inline const std::vector<core_pair>& core_pairs() {
+    static const std::vector<core_pair> pairs = [] {
+        std::vector<core_pair> result;
+#if defined(__linux__)
+        result = topology_detail::discover_core_pairs();
+#endif
+        if (result.empty()) {
+            result.push_back(core_pair{ "default", Thread1Affinity, Thread2Affinity });
+        }
+        return result;
+    }();
+    return pairs;
+}
+
+// NUMA node of the lowest CPU in affinity, -1 if unknown.
+inline int numa_node_of(uint64_t affinity) {
+#if defined(__linux__)
+    return topology_detail::node_of_cpu(topology_detail::lowest_cpu(affinity));
+#else
+    (void)affinity;
+    return -1;
+#endif
+}
@@ -0,0 +1,161 @@
+#include "spsc_queue.hpp"
+#include "spsc_ring_buffer_cached.hpp"
+#include "BenchmarkSupport.hpp"
+#include "LatencyHistogram.hpp"
+#include "Platform.hpp"
+#include "RecordTrace.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+constexpr int MessagesPerIteration = 1000;
+constexpr size_t MaxRecordLength = 4096;
+
+// read_tsc() at the time the trace says the message arrives, not when the
+// producer got it into the queue, so time the producer spends waiting for
+// space counts as queueing delay as well.
+struct message {
+    uint64_t scheduled;
+    uint32_t length;
+};
+
+// Args are the core pair and a speedup: the gaps of the trace are divided by
+// it, which raises the load without changing the shape of the bursts.
+inline void configure_trace_replay(benchmark::internal::Benchmark* bench) {
+    bench->Threads(2);
+    bench->Repetitions(repetitions(20));
+    bench->ArgNames({ "pair", "speedup" });
+    for (size_t i = 0; i < core_pairs().size(); i += 1) {
+        if (selected_benchmarks().selects_pair(core_pairs()[i]) == false)
+            continue;
+        for (int64_t speedup : { 1, 4, 16 }) {
+            bench->Args({ int64_t(i), speedup });
+        }
+    }
+}
+
+// The producer replays the trace in RBB_TRACE, waiting on read_tsc() until
+// each message is due and retrying while the queue is full. Every iteration
+// continues the trace where the last one stopped, starting over at its end,
+// and restarts the clock, so a backlog does not carry over. The consumer
+// polls and records the queueing delay of each message.
+template<typename type>
+static void TraceReplay(benchmark::State& state) {
+    static std::atomic<type*> queue = nullptr;
+
+    const core_pair& pair = core_pair_of(state);
+    state.SetLabel(pair.name);
+
+    // both threads come to the same conclusion, so neither waits for the other
+    const auto* trace = environment_trace();
+    if (trace == nullptr || trace->empty()) {
+        state.SkipWithError("RBB_TRACE does not name a valid trace");
+        return;
+    }
+
+    if (state.thread_index == 0) {
+        queue = new type{};
+    } else {
+        while (queue.load(std::memory_order_relaxed) == nullptr) {}
+    }
+
+    type& q = *queue;
+    if (state.thread_index == 0) {
+        PREPARE_THREAD(pair.producer_affinity);
+        const double ticks_per_ns = tsc_ticks_per_ns() / double(state.range(1));
+        std::vector<uint64_t> gaps;
+        gaps.reserve(trace->size());
+        for (auto& entry : *trace) {
+            gaps.push_back(uint64_t(double(entry.delta_ns) * ticks_per_ns));
+        }
+
+        size_t next = 0;
+        int64_t bytes = 0;
+        for (auto _ : state) {
+            auto due = read_tsc();
+            for (int i = 0; i < MessagesPerIteration; i += 1) {
+                due += gaps[next];
+                message m{ due, std::min(trace->at(next).length, uint32_t(MaxRecordLength)) };
+                while (read_tsc() < due) {}
+                while (q.push(m) == false) {}
+                bytes += m.length;
+                next = (next + 1) % gaps.size();
+            }
+        }
+        state.SetBytesProcessed(bytes);
+    } else if (state.thread_index == 1) {
+        PREPARE_THREAD(pair.consumer_affinity);
+        latency_histogram<> histogram;
+        for (auto _ : state) {
+            int counter = MessagesPerIteration;
+            while (counter > 0) {
+                uint64_t scheduled;
+                if (q.pop(scheduled)) {
+                    auto now = read_tsc();
+                    histogram.record(now > scheduled ? now - scheduled : 0);
+                    counter -= 1;
+                }
+            }
+        }
+        report_latency(state, histogram);
+
+        if (q.is_empty() == false) {
+            state.SkipWithError("Not Empty after test");
+        }
+
+        delete queue;
+        queue = nullptr;
+    }
+    state.SetItemsProcessed(state.iterations() * MessagesPerIteration);
+}
+
+// Fixed size messages, the length of the trace is only passed along.
+struct spsc_queue_cached_replay : spsc_queue_cached<message, 12> {
+    bool push(const message& m) {
+        return this->produce(m);
+    }
+
+    bool pop(uint64_t& scheduled) {
+        return this->consume([&scheduled](message* m) {
+            scheduled = m->scheduled;
+            return true;
+        });
+    }
+};
+
+struct spsc_queue_chunked_ptr_replay : spsc_queue_chunked_ptr<message, 4096> {
+    bool pop(uint64_t& scheduled) {
+        return this->consume([&scheduled](message& m) {
+            scheduled = m.scheduled;
+            return true;
+        });
+    }
+};
+
+// Records of the length of the trace, the consumer copies them out.
+struct spsc_ring_buffer_cached_replay : spsc_ring_buffer_cached<18> {
+    bool push(const message& m) {
+        return this->produce(sizeof(m.scheduled) + m.length, [&m](void* ptr) {
+            memcpy(ptr, &m.scheduled, sizeof(m.scheduled));
+            memset(static_cast<std::byte*>(ptr) + sizeof(m.scheduled), 0x5a, m.length);
+            return true;
+        });
+    }
+
+    bool pop(uint64_t& scheduled) {
+        return this->consume([this, &scheduled](const void* ptr, ptrdiff_t length) {
+            memcpy(_copy, ptr, size_t(length));
+            benchmark::DoNotOptimize(_copy);
+            memcpy(&scheduled, _copy, sizeof(scheduled));
+            return true;
+        });
+    }
+
+private:
+    alignas(16) std::byte _copy[sizeof(uint64_t) + MaxRecordLength];
+};
+
+BENCHMARK_TEMPLATE(TraceReplay, spsc_queue_cached_replay)->Apply(configure_trace_replay);
+BENCHMARK_TEMPLATE(TraceReplay, spsc_queue_chunked_ptr_replay)->Apply(configure_trace_replay);
+BENCHMARK_TEMPLATE(TraceReplay, spsc_ring_buffer_cached_replay)->Apply(configure_trace_replay);
@@ -0,0 +1,202 @@
+#include "spsc_ring_buffer.hpp"
+#include "spsc_ring_buffer_cached.hpp"
+#include "spsc_ring_buffer_chunked.hpp"
+#include "spsc_ring_buffer_heap.hpp"
+#include "BenchmarkSupport.hpp"
+#include "Platform.hpp"
+#include "RecordTrace.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+constexpr int RecordsPerIteration = 10000;
+constexpr size_t MaxRecordLength = 4096;
+
+enum length_distribution {
+    fixed_length,     // 64 bytes
+    uniform_length,   // 8 to 1024 bytes
+    bimodal_length,   // 90% 16 to 128 bytes, 10% 1024 to 4096 bytes
+    trace_length,     // lengths of the trace in RBB_TRACE
+    distribution_count
+};
+
+static const char* distribution_name(int distribution) {
+    static const char* const names[distribution_count] = { "fixed", "uniform", "bimodal", "trace" };
+    return names[distribution];
+}
+
+// Same sequence of lengths for every buffer, from a fixed xorshift seed.
+// Trace lengths above MaxRecordLength are clamped. Empty if the distribution
+// is trace and RBB_TRACE does not name a valid trace.
+static std::vector<size_t> record_lengths(int distribution) {
+    std::vector<size_t> result;
+    if (distribution == trace_length) {
+        if (auto* trace = environment_trace()) {
+            for (auto& entry : *trace) {
+                result.push_back(std::clamp(size_t(entry.length), size_t(1), MaxRecordLength));
+            }
+        }
+        return result;
+    }
+
+    uint32_t x = 2463534242u;
+    auto next = [&x](size_t min, size_t max) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        return min + x % (max - min + 1);
+    };
+
+    result.resize(4096);
+    for (auto& length : result) {
+        switch (distribution) {
+        case fixed_length:
+            length = 64;
+            break;
+        case uniform_length:
+            length = next(8, 1024);
+            break;
+        case bimodal_length:
+            length = next(0, 9) == 0 ? next(1024, 4096) : next(16, 128);
+            break;
+        }
+    }
+    return result;
+}
+
+// Padding left at the end of the buffer when a record does not fit in front
+// of it. All buffers but spsc_ring_buffer_chunked place their records
+// independent of the timing of the consumer, so the producer can follow the
+// placement without looking into the buffer. wrap_waste is the fraction of
+// the bytes the producer advanced over that are padding.
+// spsc_ring_buffer_chunked switches chunks depending on the consumer and does
+// not report it.
+template<typename type, typename = void>
+struct wrap_waste {
+    void add(size_t length) noexcept {
+        auto rounded_length = ctu::round_up_bits(length + sizeof(typename type::difference_type), type::content_align_log2);
+        if (type::size - _offset < rounded_length) {
+            _wasted += type::size - _offset;
+            _offset = 0;
+        }
+        _offset = (_offset + rounded_length) & type::mask;
+        _written += rounded_length;
+    }
+
+    void report(benchmark::State& state) const {
+        state.counters["wrap_waste"] = _written > 0 ? double(_wasted) / double(_written + _wasted) : 0.0;
+    }
+
+private:
+    size_t _offset = 0;
+    uint64_t _wasted = 0;
+    uint64_t _written = 0;
+};
+
+template<typename type>
+struct wrap_waste<type, std::void_t<decltype(type::chunk_size)>> {
+    void add(size_t) noexcept {}
+    void report(benchmark::State&) const {}
+};
+
+// Args are the core pair, the length distribution and the batch size: the
+// consumer takes up to batch records per drain() and publishes its position
+// once per batch.
+inline void configure_variable_length_queue(benchmark::internal::Benchmark* bench) {
+    bench->Threads(2);
+    bench->Repetitions(repetitions(20));
+    bench->ArgNames({ "pair", "distribution", "batch" });
+    for (size_t i = 0; i < core_pairs().size(); i += 1) {
+        if (selected_benchmarks().selects_pair(core_pairs()[i]) == false)
+            continue;
+        for (int64_t distribution = 0; distribution < distribution_count; distribution += 1) {
+            for (int64_t batch : { 1, 8, 64 }) {
+                bench->Args({ int64_t(i), distribution, batch });
+            }
+        }
+    }
+}
+
+template<typename type>
+static void VariableLength(benchmark::State& state) {
+    static std::atomic<type*> queue = nullptr;
+
+    const core_pair& pair = core_pair_of(state);
+    const auto distribution = int(state.range(1));
+    state.SetLabel(std::string(pair.name) + "/" + distribution_name(distribution));
+
+    // both threads come to the same conclusion, so neither waits for the other
+    const auto lengths = record_lengths(distribution);
+    if (lengths.empty()) {
+        state.SkipWithError("RBB_TRACE does not name a valid trace");
+        return;
+    }
+
+    if (state.thread_index == 0) {
+        queue = new type{};
+    } else {
+        while (queue.load(std::memory_order_relaxed) == nullptr) {}
+    }
+
+    type& q = *queue;
+    if (state.thread_index == 0) {
+        PREPARE_THREAD(pair.producer_affinity);
+        wrap_waste<type> waste;
+        size_t next = 0;
+        int64_t bytes = 0;
+        for (auto _ : state) {
+            int counter = RecordsPerIteration;
+            while (counter > 0) {
+                size_t length = lengths[next];
+                if (q.produce(length, [length](void* ptr) {
+                    memset(ptr, 0x5a, length);
+                    return true;
+                })) {
+                    waste.add(length);
+                    next = (next + 1) % lengths.size();
+                    bytes += int64_t(length);
+                    counter -= 1;
+                }
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * RecordsPerIteration);
+        state.SetBytesProcessed(bytes);
+        waste.report(state);
+    } else if (state.thread_index == 1) {
+        PREPARE_THREAD(pair.consumer_affinity);
+        const auto batch = size_t(state.range(2));
+        alignas(16) std::byte copy[MaxRecordLength];
+        uint64_t consumed = 0;
+        uint64_t quota = 0;
+        for (auto _ : state) {
+            quota += RecordsPerIteration;
+            while (consumed < quota) {
+                size_t taken = 0;
+                consumed += q.drain([&copy, &taken, batch](const void* ptr, ptrdiff_t length) {
+                    if (taken == batch)
+                        return false;
+                    taken += 1;
+                    memcpy(copy, ptr, size_t(length));
+                    benchmark::DoNotOptimize(copy);
+                    return true;
+                }, 0).records;
+            }
+        }
+        state.SetItemsProcessed(int64_t(consumed));
+
+        if (q.is_empty() == false) {
+            state.SkipWithError("Not Empty after test");
+        }
+
+        delete queue;
+        queue = nullptr;
+    }
+}
+
+BENCHMARK_TEMPLATE(VariableLength, spsc_ring_buffer<16>)->Apply(configure_variable_length_queue);
+BENCHMARK_TEMPLATE(VariableLength, spsc_ring_buffer_cached<16>)->Apply(configure_variable_length_queue);
+BENCHMARK_TEMPLATE(VariableLength, spsc_ring_buffer_heap<16>)->Apply(configure_variable_length_queue);
+BENCHMARK_TEMPLATE(VariableLength, spsc_ring_buffer_chunked<20>)->Apply(configure_variable_length_queue);
@@ -0,0 +1,122 @@
+#include "ce_queue.hpp"
+#include "spsc_queue.hpp"
+#include "spsc_ring_buffer_cached.hpp"
+#include "wait_strategy.hpp"
+#include "BenchmarkSupport.hpp"
+#include "LatencyHistogram.hpp"
+#include "Platform.hpp"
+#include <chrono>
+#include <cstdint>
+#include <new>
+
+// read_tsc() at the time the message was produced
+using timestamp = uint64_t;
+
+constexpr int MessagesPerIteration = 1000;
+
+// The producer sends timestamps, paced by the interval argument, using the
+// blocking operations of the queue. The consumer blocks as well and records
+// the time from produce to consume for each message, plus its own CPU time.
+template<typename type>
+static void WaitStrategyLatency(benchmark::State& state) {
+    static std::atomic<type*> queue = nullptr;
+
+    const core_pair& pair = core_pair_of(state);
+    state.SetLabel(pair.name);
+    const auto interval = std::chrono::microseconds(state.range(1));
+
+    if (state.thread_index == 0) {
+        queue = new type{};
+    } else {
+        while (queue.load(std::memory_order_relaxed) == nullptr) {}
+    }
+
+    type& q = *queue;
+    if (state.thread_index == 0) {
+        PREPARE_THREAD(pair.producer_affinity);
+        for (auto _ : state) {
+            auto next = std::chrono::steady_clock::now();
+            for (int i = 0; i < MessagesPerIteration; i += 1) {
+                while (std::chrono::steady_clock::now() < next) {}
+                q.produce_wait(read_tsc());
+                next += interval;
+            }
+        }
+    } else if (state.thread_index == 1) {
+        PREPARE_THREAD(pair.consumer_affinity);
+        latency_histogram<> histogram;
+
+        auto cpu_start = thread_cpu_time_ns();
+        auto wall_start = std::chrono::steady_clock::now();
+        for (auto _ : state) {
+            for (int i = 0; i < MessagesPerIteration; i += 1) {
+                q.consume_wait([&histogram](const timestamp* sent) {
+                    histogram.record(read_tsc() - *sent);
+                    return true;
+                });
+            }
+        }
+        auto cpu_time = thread_cpu_time_ns() - cpu_start;
+        auto wall_time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - wall_start).count();
+
+        report_latency(state, histogram);
+        // fraction of a core the consumer used, 1.0 means it never slept
+        state.counters["consumer_cpu"] = wall_time > 0 ? double(cpu_time) / double(wall_time) : 0.0;
+
+        if (q.is_empty() == false) {
+            state.SkipWithError("Not Empty after test");
+        }
+
+        delete queue;
+        queue = nullptr;
+    }
+    state.SetItemsProcessed(state.iterations() * MessagesPerIteration);
+}
+
+template<typename wait_strategy>
+using spsc_queue_waiting = spsc_queue<timestamp, 10, 7, wait_strategy>;
+
+template<typename wait_strategy>
+using spsc_queue_cached_waiting = spsc_queue_cached<timestamp, 10, 7, wait_strategy>;
+
+template<typename wait_strategy>
+struct spsc_queue_chunked_ptr_waiting : spsc_queue_chunked_ptr<timestamp, 1024, (1 << 15), 7, wait_strategy> {
+    using base_type = spsc_queue_chunked_ptr<timestamp, 1024, (1 << 15), 7, wait_strategy>;
+
+    template<typename callable>
+    void consume_wait(callable&& callback) {
+        base_type::consume_wait([&callback](timestamp& elem) { return callback(&elem); });
+    }
+};
+
+template<typename wait_strategy>
+struct ce_queue_waiting : ce_queue<timestamp, 1024, 7, wait_strategy> {
+    void produce_wait(const timestamp& t) {
+        this->emplace_wait(t);
+    }
+};
+
+template<typename wait_strategy>
+struct spsc_ring_buffer_cached_waiting : spsc_ring_buffer_cached<13, 3, ptrdiff_t, 7, wait_strategy> {
+    using base_type = spsc_ring_buffer_cached<13, 3, ptrdiff_t, 7, wait_strategy>;
+
+    void produce_wait(const timestamp& t) {
+        base_type::produce_wait(sizeof(t), [&t](void* ptr) {
+            new(ptr) timestamp(t);
+            return true;
+        });
+    }
+
+    template<typename callable>
+    void consume_wait(callable&& callback) {
+        base_type::consume_wait([&callback](const void* ptr, ptrdiff_t) {
+            return callback(std::launder(static_cast<const timestamp*>(ptr)));
+        });
+    }
+};
+
+WAIT_STRATEGY_BENCH(WaitStrategyLatency, spsc_queue_waiting);
+WAIT_STRATEGY_BENCH(WaitStrategyLatency, spsc_queue_cached_waiting);
+WAIT_STRATEGY_BENCH(WaitStrategyLatency, spsc_queue_chunked_ptr_waiting);
+WAIT_STRATEGY_BENCH(WaitStrategyLatency, ce_queue_waiting);
+WAIT_STRATEGY_BENCH(WaitStrategyLatency, spsc_ring_buffer_cached_waiting);
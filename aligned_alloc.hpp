@@ -27,3 +27,16 @@ struct aligned_free_deleter {
         aligned_free(ptr);
     }
 };
+
+// Allocator policy for the containers with runtime capacity. Any type with
+// the same static interface can be used instead.
+struct aligned_allocator {
+    // size is rounded up to a multiple of alignment, as aligned_alloc requires
+    static void* allocate(std::size_t alignment, std::size_t size) {
+        return aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1));
+    }
+
+    static void deallocate(void* ptr, std::size_t /*size*/) noexcept {
+        aligned_free(ptr);
+    }
+};
@@ -3,12 +3,14 @@
 #include <array>
 #include <atomic>
 #include <cstddef>
+#include "wait_strategy.hpp"
 
-template<typename T, size_t _queue_size, int _align_log2 = 7>
+template<typename T, size_t _queue_size, int _align_log2 = 7, typename _wait_strategy = busy_spin_wait>
 struct ce_queue {
     using value_type = T;
     static const auto size = _queue_size;
     static const auto align = size_t(1) << _align_log2;
+    using wait_strategy = _wait_strategy;
 
     struct alignas(alignof(value_type)) node {
         std::array<std::byte, sizeof(value_type)> storage;
@@ -30,10 +32,18 @@ struct ce_queue {
         produce_pos += 1;
         if (produce_pos == size) produce_pos = 0;
         _produce_pos = produce_pos;
+        _not_empty.notify();
 
         return true;
     }
 
+    // blocks until the element was produced, see wait_strategy.hpp
+    template<typename... Args>
+    void emplace_wait(Args&& ... args) {
+        // emplace only forwards args once it is sure to succeed
+        _not_full.wait([&] { return this->emplace(std::forward<Args>(args)...); });
+    }
+
     template<typename Callable>
     bool consume(Callable&& f) {
         auto consume_pos = _consume_pos;
@@ -50,11 +60,18 @@ struct ce_queue {
             consume_pos += 1;
             if (consume_pos == size) consume_pos = 0;
             _consume_pos = consume_pos;
+            _not_full.notify();
             return true;
         }
         return false;
     }
 
+    // blocks until an element was consumed, f must accept it
+    template<typename Callable>
+    void consume_wait(Callable&& f) {
+        _not_empty.wait([&] { return this->consume(f); });
+    }
+
     bool is_empty() const {
         return _buffer[_consume_pos].occupied.load(std::memory_order_acquire) == false;
     }
@@ -62,14 +79,17 @@ struct ce_queue {
 private:
     alignas(align) std::array<node, size> _buffer;
     alignas(align) size_t _produce_pos = 0;
+    wait_strategy _not_empty;
     alignas(align) size_t _consume_pos = 0;
+    wait_strategy _not_full;
 };
 
-template<typename T, size_t _queue_size, int _align_log2 = 7>
+template<typename T, size_t _queue_size, int _align_log2 = 7, typename _wait_strategy = busy_spin_wait>
 struct ce_queue2 {
     using value_type = T;
     static const auto size = _queue_size;
     static const auto align = size_t(1) << _align_log2;
+    using wait_strategy = _wait_strategy;
 
     ce_queue2() = default;
 
@@ -87,10 +107,18 @@ struct ce_queue2 {
         produce_pos += 1;
         if (produce_pos == size) produce_pos = 0;
         _produce_pos = produce_pos;
+        _not_empty.notify();
 
         return true;
     }
 
+    // blocks until the element was produced, see wait_strategy.hpp
+    template<typename... Args>
+    void emplace_wait(Args&& ... args) {
+        // emplace only forwards args once it is sure to succeed
+        _not_full.wait([&] { return this->emplace(std::forward<Args>(args)...); });
+    }
+
     template<typename Callable>
     bool consume(Callable&& f) {
         auto consume_pos = _consume_pos;
@@ -109,12 +137,19 @@ struct ce_queue2 {
             consume_pos += 1;
             if (consume_pos == size) consume_pos = 0;
             _consume_pos = consume_pos;
+            _not_full.notify();
             return true;
         }
 
         return false;
     }
 
+    // blocks until an element was consumed, f must accept it
+    template<typename Callable>
+    void consume_wait(Callable&& f) {
+        _not_empty.wait([&] { return this->consume(f); });
+    }
+
     bool is_empty() const {
         return _info[_consume_pos].load(std::memory_order_acquire) == false;
     }
@@ -123,5 +158,7 @@ private:
     alignas(align) std::array<std::atomic_bool, size> _info;
     alignas(align) std::array<std::byte, size * sizeof(T)> _buffer;
     alignas(align) size_t _produce_pos = 0;
+    wait_strategy _not_empty;
     alignas(align) size_t _consume_pos = 0;
+    wait_strategy _not_full;
 };
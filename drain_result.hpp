@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstddef>
+
+// Returned by the drain operation of the ring buffers: records consumed and
+// the sum of their lengths in bytes.
+struct drain_result {
+    size_t records = 0;
+    size_t bytes = 0;
+};
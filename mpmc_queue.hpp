@@ -3,51 +3,81 @@
 #include <array>
 #include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <utility>
 
+// Bounded multi-producer/multi-consumer queue. Elements are constructed in
+// place inside _storage, the ring of _queue slots only passes storage indices
+// from producers to consumers. Unused storage indices are kept in a lock-free
+// free-list threaded through _unused.
+//
+// Storage index 0 is never handed out, so at most size - 1 elements can be in
+// the queue at the same time.
 template<typename _type, std::size_t _size, int _align_log2 = 7>
 struct alignas(1 << _align_log2) mpmc_queue {
     using value_type = _type;
     using size_type = std::size_t;
     static const auto size = _size;
     static const auto align = size_type(1) << _align_log2;
-    
-    alignas(align) std::array<std::size_t, size> _unused{};
-    std::atomic_size_t _unused_head{ 0 };
+
+    static_assert(size > 1, "Queue must have room for at least one element");
+    static_assert(size <= (std::uint64_t(1) << 32), "Storage indices must fit into 32 bits");
+    static_assert(alignof(value_type) <= align, "Elements must not have stronger alignment requirements than this queue");
+
+    // Both _unused_head and the slots in _queue pack a 32 bit index with a 32
+    // bit tag in the upper half. For _unused_head the tag is incremented on
+    // every modification to prevent ABA. For slots in _queue, the tag is the
+    // lap of the position that may use the slot next, so that producers and
+    // consumers one lap apart cannot interfere with each other.
+    static const std::uint64_t index_mask = 0xFFFFFFFF;
+    static const std::uint64_t tag_one = index_mask + 1;
+
+    alignas(align) std::array<std::atomic<std::uint64_t>, size> _unused{};
+    std::atomic<std::uint64_t> _unused_head{ 0 };
 
     alignas(align) std::array<std::byte, sizeof(_type) * size> _storage;
     std::atomic_size_t _storage_head{ 1 };
 
-    alignas(align) std::array<std::atomic_size_t, size> _queue{};
-    alignas(align) std::atomic_size_t _tail{};
-    alignas(align) std::atomic_size_t _head{};
-
-    static const std::size_t TOMBSTONE = ~std::size_t(0);
+    alignas(align) std::array<std::atomic<std::uint64_t>, size> _queue{};
+    alignas(align) std::atomic<std::uint64_t> _tail{};
+    alignas(align) std::atomic<std::uint64_t> _head{};
 
     mpmc_queue() {}
 
+    ~mpmc_queue() {
+        while (Dequeue([](value_type&&) {})) {}
+    }
+
     std::size_t allocate() {
         auto unused_head = _unused_head.load(std::memory_order_acquire);
         while (true) {
-            if (unused_head == 0) {
-                // get new storage
-                auto storage_head = _storage_head.load(std::memory_order_acquire);
+            auto idx = unused_head & index_mask;
+            if (idx == 0) {
+                // free-list is empty, get new storage
+                auto storage_head = _storage_head.load(std::memory_order_relaxed);
                 while (true) {
                     if (storage_head >= size)
                         return 0;
-                    if (_storage_head.compare_exchange_weak(storage_head, storage_head + 1, std::memory_order_acq_rel))
+                    if (_storage_head.compare_exchange_weak(storage_head, storage_head + 1, std::memory_order_relaxed))
                         return storage_head;
                 }
-            } 
-            if (_unused_head.compare_exchange_weak(unused_head, _unused[unused_head], std::memory_order_acq_rel))
-                return unused_head;
+            }
+
+            auto next = _unused[idx].load(std::memory_order_relaxed);
+            auto tag = (unused_head & ~index_mask) + tag_one;
+            if (_unused_head.compare_exchange_weak(unused_head, tag | next, std::memory_order_acquire))
+                return std::size_t(idx);
         }
     }
 
     void free(std::size_t idx) {
-        auto unused_head = _unused_head.load(std::memory_order_acquire);
+        auto unused_head = _unused_head.load(std::memory_order_relaxed);
         while (true) {
-            _unused[idx] = unused_head;
-            if (_unused_head.compare_exchange_weak(unused_head, idx, std::memory_order_acq_rel))
+            _unused[idx].store(unused_head & index_mask, std::memory_order_relaxed);
+            auto tag = (unused_head & ~index_mask) + tag_one;
+            if (_unused_head.compare_exchange_weak(unused_head, tag | idx, std::memory_order_release, std::memory_order_relaxed))
                 break;
         }
     }
@@ -59,31 +89,49 @@ struct alignas(1 << _align_log2) mpmc_queue {
 
         new(_storage.data() + idx * sizeof(_type)) _type(std::forward<Args>(args)...);
 
-        auto tail = _tail.load(std::memory_order_acq_rel);
-        while (true) {
-            auto next = tail + 1;
-            if (next == size) next = 0;
-            if (_tail.compare_exchange_weak(tail, next, std::memory_order_acq_rel))
-                break;
-        }
-        _queue[tail].store(idx, std::memory_order_release);
+        auto tail = _tail.fetch_add(1, std::memory_order_relaxed);
+        auto lap = std::uint32_t(tail / size);
+        auto& slot = _queue[tail % size];
+
+        // a consumer from the previous lap may not have taken its element yet
+        while (slot.load(std::memory_order_acquire) != (std::uint64_t(lap) << 32)) {}
+
+        slot.store((std::uint64_t(lap) << 32) | idx, std::memory_order_release);
         return true;
     }
 
     template<typename Callback>
     bool Dequeue(Callback&& f) {
-        auto head = _head.load(std::memory_order_acquire);
+        auto head = _head.load(std::memory_order_relaxed);
         while (true) {
             auto tail = _tail.load(std::memory_order_acquire);
             if (head == tail) return false;
-            auto next = head + 1;
-            if (next == size) next = 0;
-            if (_head.compare_exchange_weak(head, next, std::memory_order_acq_rel))
+            if (_head.compare_exchange_weak(head, head + 1, std::memory_order_relaxed))
                 break;
         }
 
-        while (_queue[head].load(std::memory_order_acquire) == 0) {}
+        auto lap = std::uint32_t(head / size);
+        auto& slot = _queue[head % size];
+
+        // the producer that claimed this position may not have published its
+        // element yet
+        std::uint64_t value;
+        do {
+            value = slot.load(std::memory_order_acquire);
+        } while ((value >> 32) != lap || (value & index_mask) == 0);
 
+        slot.store(std::uint64_t(std::uint32_t(lap + 1)) << 32, std::memory_order_release);
+
+        auto idx = std::size_t(value & index_mask);
+        _type* elem = std::launder(reinterpret_cast<_type*>(_storage.data() + idx * sizeof(_type)));
+        std::invoke(std::forward<Callback>(f), std::move(*elem));
+        elem->~_type();
+
+        free(idx);
         return true;
     }
+
+    bool is_empty() const {
+        return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
+    }
 };
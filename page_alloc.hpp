@@ -0,0 +1,222 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "aligned_alloc.hpp"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <fstream>
+#include <string>
+#endif
+
+// Allocator policies that get their memory from the OS in whole pages, with
+// the same interface as aligned_allocator. All memory is touched before
+// allocate returns, so page faults do not end up in measurements.
+//
+// On Linux the pages are placed on numa_target_node() if it is set (using
+// mbind with MPOL_PREFERRED), otherwise on the node of the allocating thread
+// (first touch). On other platforms all policies fall back to
+// aligned_allocator and the huge page policies report that they are not
+// available.
+
+// NUMA node the page allocators place new allocations on, -1 for the node of
+// the allocating thread.
+inline std::atomic<int>& numa_target_node() {
+    static std::atomic<int> node{ -1 };
+    return node;
+}
+
+namespace page_alloc_detail {
+
+constexpr std::size_t small_page_size = 4096;
+
+inline std::size_t round_up(std::size_t size, std::size_t page_size) {
+    return (size + page_size - 1) & ~(page_size - 1);
+}
+
+#if defined(__linux__)
+inline void bind_to_target_node(void* ptr, std::size_t size) {
+    int node = numa_target_node().load();
+    if (node < 0 || node >= 64)
+        return;
+
+    // no libnuma dependency for a single call
+    const int mpol_preferred = 1;
+    unsigned long mask = 1ul << node;
+    syscall(SYS_mbind, ptr, size, mpol_preferred, &mask, sizeof(mask) * 8 + 1, 0);
+}
+
+// Maps size bytes at an address aligned to alignment, both multiples of the
+// small page size. Larger alignments are achieved by mapping more than needed
+// and unmapping the excess.
+inline void* map_aligned(std::size_t size, std::size_t alignment, int flags) {
+    const int prot = PROT_READ | PROT_WRITE;
+    flags |= MAP_PRIVATE | MAP_ANONYMOUS;
+
+    if (alignment <= small_page_size) {
+        void* ptr = mmap(nullptr, size, prot, flags, -1, 0);
+        return ptr == MAP_FAILED ? nullptr : ptr;
+    }
+
+    void* raw = mmap(nullptr, size + alignment, prot, flags, -1, 0);
+    if (raw == MAP_FAILED)
+        return nullptr;
+
+    auto begin = reinterpret_cast<std::uintptr_t>(raw);
+    auto aligned = (begin + alignment - 1) & ~std::uintptr_t(alignment - 1);
+    if (aligned != begin) {
+        munmap(raw, aligned - begin);
+    }
+    auto tail = (begin + size + alignment) - (aligned + size);
+    if (tail != 0) {
+        munmap(reinterpret_cast<void*>(aligned + size), tail);
+    }
+    return reinterpret_cast<void*>(aligned);
+}
+
+inline void* prepare_pages(void* ptr, std::size_t size, int advice) {
+    if (ptr == nullptr)
+        return nullptr;
+
+    if (advice >= 0) {
+        madvise(ptr, size, advice);
+    }
+    bind_to_target_node(ptr, size);
+
+    auto bytes = static_cast<volatile char*>(ptr);
+    for (std::size_t i = 0; i < size; i += small_page_size) {
+        bytes[i] = 0;
+    }
+    return ptr;
+}
+
+inline bool read_first_line(const char* path, std::string& line) {
+    std::ifstream file(path);
+    return bool(std::getline(file, line));
+}
+#endif
+
+} // namespace page_alloc_detail
+
+// Regular 4K pages. Transparent huge pages are disabled for the mapping, so
+// this is the baseline regardless of the system wide THP setting.
+struct small_page_allocator {
+    static void* allocate(std::size_t alignment, std::size_t size) {
+#if defined(__linux__)
+        using namespace page_alloc_detail;
+        if (alignment > small_page_size)
+            return nullptr;
+        auto rounded = round_up(size, small_page_size);
+        return prepare_pages(map_aligned(rounded, small_page_size, 0), rounded, MADV_NOHUGEPAGE);
+#else
+        return aligned_allocator::allocate(alignment, size);
+#endif
+    }
+
+    static void deallocate(void* ptr, std::size_t size) noexcept {
+#if defined(__linux__)
+        munmap(ptr, page_alloc_detail::round_up(size, page_alloc_detail::small_page_size));
+#else
+        aligned_allocator::deallocate(ptr, size);
+#endif
+    }
+
+    static bool available() {
+        return true;
+    }
+};
+
+// 2M aligned anonymous memory, advised to be backed by transparent huge pages.
+// Whether it actually is depends on the system wide THP configuration and on
+// memory fragmentation; available() only checks the former.
+struct transparent_huge_page_allocator {
+    static const std::size_t page_size = std::size_t(1) << 21;
+
+    static void* allocate(std::size_t alignment, std::size_t size) {
+#if defined(__linux__)
+        using namespace page_alloc_detail;
+        if (alignment > page_size)
+            return nullptr;
+        auto rounded = round_up(size, page_size);
+        return prepare_pages(map_aligned(rounded, page_size, 0), rounded, MADV_HUGEPAGE);
+#else
+        return aligned_allocator::allocate(alignment, size);
+#endif
+    }
+
+    static void deallocate(void* ptr, std::size_t size) noexcept {
+#if defined(__linux__)
+        munmap(ptr, page_alloc_detail::round_up(size, page_size));
+#else
+        aligned_allocator::deallocate(ptr, size);
+#endif
+    }
+
+    static bool available() {
+#if defined(__linux__)
+        std::string enabled;
+        if (page_alloc_detail::read_first_line("/sys/kernel/mm/transparent_hugepage/enabled", enabled) == false)
+            return false;
+        return enabled.find("[never]") == std::string::npos;
+#else
+        return false;
+#endif
+    }
+};
+
+// Explicit huge pages from the hugetlbfs pool (MAP_HUGETLB), 2M or 1G on
+// x86-64. The pool has to be reserved beforehand, eg. through
+// /sys/kernel/mm/hugepages/hugepages-2048kB/nr_hugepages. There is no
+// fallback to smaller pages, allocate returns nullptr if the pool is empty.
+template<int _page_size_log2>
+struct huge_page_allocator {
+    static const std::size_t page_size = std::size_t(1) << _page_size_log2;
+
+    static void* allocate(std::size_t alignment, std::size_t size) {
+#if defined(__linux__)
+        using namespace page_alloc_detail;
+        if (alignment > page_size)
+            return nullptr;
+        auto rounded = round_up(size, page_size);
+        return prepare_pages(map_aligned(rounded, small_page_size, flags), rounded, -1);
+#else
+        (void)alignment;
+        (void)size;
+        return nullptr;
+#endif
+    }
+
+    static void deallocate(void* ptr, std::size_t size) noexcept {
+#if defined(__linux__)
+        munmap(ptr, page_alloc_detail::round_up(size, page_size));
+#else
+        (void)ptr;
+        (void)size;
+#endif
+    }
+
+    // Tries to map a single page, once.
+    static bool available() {
+#if defined(__linux__)
+        static const bool result = [] {
+            void* ptr = page_alloc_detail::map_aligned(page_size, page_alloc_detail::small_page_size, flags);
+            if (ptr == nullptr)
+                return false;
+            munmap(ptr, page_size);
+            return true;
+        }();
+        return result;
+#else
+        return false;
+#endif
+    }
+
+private:
+#if defined(__linux__)
+    static const int flags = MAP_HUGETLB | (_page_size_log2 << MAP_HUGE_SHIFT);
+#endif
+};
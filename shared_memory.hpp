@@ -0,0 +1,164 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <system_error>
+#include <utility>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Start of every data structure that can be constructed in shared memory.
+// create fills it in, attach checks it before handing out a pointer. magic is
+// stored last, so an attaching process never accepts a structure that is
+// still being constructed.
+struct shm_header {
+    std::atomic<uint64_t> magic;
+    uint32_t version;
+    // layout parameters the other process was compiled with, eg. sizeof(T)
+    uint32_t layout;
+    uint64_t capacity;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Atomics in shared memory must be lock-free");
+static_assert(std::atomic<size_t>::is_always_lock_free, "Atomics in shared memory must be lock-free");
+
+// Eight characters packed into the magic number of a shm_header.
+constexpr uint64_t shm_magic(const char (&tag)[9]) {
+    uint64_t result = 0;
+    for (int i = 0; i < 8; i += 1) {
+        result = (result << 8) | uint64_t(uint8_t(tag[i]));
+    }
+    return result;
+}
+
+// A named POSIX shared memory segment, mapped into this process. Destroying
+// the object (or calling detach) only unmaps it, the segment lives on until it
+// is removed by name. Only available on Linux, elsewhere create and open throw
+// std::system_error.
+struct shared_memory_segment {
+    shared_memory_segment() = default;
+
+    shared_memory_segment(const shared_memory_segment&) = delete;
+    shared_memory_segment& operator=(const shared_memory_segment&) = delete;
+
+    shared_memory_segment(shared_memory_segment&& other) noexcept :
+        _data(std::exchange(other._data, nullptr)),
+        _size(std::exchange(other._size, 0)) {}
+
+    shared_memory_segment& operator=(shared_memory_segment&& other) noexcept {
+        if (this != &other) {
+            detach();
+            _data = std::exchange(other._data, nullptr);
+            _size = std::exchange(other._size, 0);
+        }
+        return *this;
+    }
+
+    ~shared_memory_segment() {
+        detach();
+    }
+
+    // Creates a new, zero-filled segment. Fails if the name is already taken.
+    static shared_memory_segment create(const char* name, size_t size) {
+#if defined(__linux__)
+        int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+        if (fd < 0)
+            throw_errno("shm_open");
+
+        if (ftruncate(fd, off_t(size)) != 0) {
+            int error = errno;
+            close(fd);
+            shm_unlink(name);
+            throw std::system_error(error, std::generic_category(), "ftruncate");
+        }
+
+        return map(fd, size);
+#else
+        (void)name;
+        (void)size;
+        throw_unsupported();
+#endif
+    }
+
+    // Attaches to a segment created by another process.
+    static shared_memory_segment open(const char* name) {
+#if defined(__linux__)
+        int fd = shm_open(name, O_RDWR, 0);
+        if (fd < 0)
+            throw_errno("shm_open");
+
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            int error = errno;
+            close(fd);
+            throw std::system_error(error, std::generic_category(), "fstat");
+        }
+
+        return map(fd, size_t(info.st_size));
+#else
+        (void)name;
+        throw_unsupported();
+#endif
+    }
+
+    // Removes the name, the memory is released once every process detached.
+    static void remove(const char* name) noexcept {
+#if defined(__linux__)
+        shm_unlink(name);
+#else
+        (void)name;
+#endif
+    }
+
+    void detach() noexcept {
+#if defined(__linux__)
+        if (_data != nullptr) {
+            munmap(_data, _size);
+        }
+#endif
+        _data = nullptr;
+        _size = 0;
+    }
+
+    void* data() const noexcept {
+        return _data;
+    }
+
+    size_t size() const noexcept {
+        return _size;
+    }
+
+private:
+#if defined(__linux__)
+    [[noreturn]] static void throw_errno(const char* what) {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+
+    // takes ownership of fd, the mapping stays valid after it is closed
+    static shared_memory_segment map(int fd, size_t size) {
+        void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        int error = errno;
+        close(fd);
+        if (data == MAP_FAILED)
+            throw std::system_error(error, std::generic_category(), "mmap");
+
+        shared_memory_segment result;
+        result._data = data;
+        result._size = size;
+        return result;
+    }
+#else
+    [[noreturn]] static void throw_unsupported() {
+        throw std::system_error(std::make_error_code(std::errc::function_not_supported), "shared_memory_segment");
+    }
+#endif
+
+    void* _data = nullptr;
+    size_t _size = 0;
+};
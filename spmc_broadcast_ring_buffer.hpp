@@ -0,0 +1,204 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include "compile_time_utilities.hpp"
+#include "scope_guard.hpp"
+
+// Ring buffer with one producer and up to _max_readers readers, every one of
+// which sees every record, in the style of a disruptor. The record format is
+// that of spsc_ring_buffer_masked. Each reader has its own cursor on its own
+// cache line. The producer may only overwrite what the slowest reader has
+// consumed, it caches that position and only scans all cursors when the cached
+// one does not leave enough room.
+//
+// The number of readers is fixed at construction, readers are identified by
+// their index (0 to reader_count - 1). A reader must not modify a record, as
+// the others read it as well.
+template<
+    int _buffer_size_log2,
+    size_t _max_readers = 8,
+    int _content_align_log2 = ctu::log2_v<sizeof(void*)>,
+    typename _difference_type = ptrdiff_t,
+    int _align_log2 = 7
+>
+struct alignas(((size_t) 1) << _align_log2) spmc_broadcast_ring_buffer {
+    using difference_type = _difference_type;
+    static const auto size = size_t(1) << _buffer_size_log2;
+    static const auto mask = ctu::bit_mask_v<size_t, _buffer_size_log2>;
+    static const auto align = size_t(1) << _align_log2;
+    static const auto content_align_log2 = _content_align_log2;
+    static const auto max_readers = _max_readers;
+
+    static_assert(std::is_signed_v<difference_type>);
+    static_assert(content_align_log2 >= ctu::log2(sizeof(difference_type)));
+    static_assert(max_readers > 0);
+
+    explicit spmc_broadcast_ring_buffer(size_t reader_count = max_readers) :
+        _reader_count(reader_count)
+    {
+        if (reader_count == 0 || reader_count > max_readers)
+            throw std::invalid_argument("reader_count");
+    }
+
+    spmc_broadcast_ring_buffer(const spmc_broadcast_ring_buffer&) = delete;
+    spmc_broadcast_ring_buffer& operator=(const spmc_broadcast_ring_buffer&) = delete;
+
+    size_t reader_count() const noexcept {
+        return _reader_count;
+    }
+
+    template<typename cbtype>
+    bool produce(size_t length, cbtype callback) noexcept(noexcept(callback(static_cast<void*>(nullptr)))) {
+        if (length <= 0 || length >= size)
+            return false;
+
+        auto rounded_length = ctu::round_up_bits(length + sizeof(difference_type), content_align_log2);
+
+        if constexpr (size >= size_t(std::numeric_limits<difference_type>::max())) {
+            if (rounded_length > size_t(std::numeric_limits<difference_type>::max()))
+                return false;
+        }
+
+        auto consume_pos = _min_consume_pos_cache;
+        auto produce_pos = _produce_pos.load(std::memory_order_relaxed);
+
+        if ((produce_pos - consume_pos) > (size - rounded_length)) {
+            consume_pos = _min_consume_pos_cache = min_consume_pos();
+            if ((produce_pos - consume_pos) > (size - rounded_length))
+                return false;
+        }
+
+        auto wrap_distance = size - (produce_pos & mask);
+        if (wrap_distance < rounded_length) {
+            if ((produce_pos + wrap_distance - consume_pos) > (size - rounded_length)) {
+                consume_pos = _min_consume_pos_cache = min_consume_pos();
+                if ((produce_pos + wrap_distance - consume_pos) > (size - rounded_length))
+                    return false;
+            }
+
+            new (_buffer + (produce_pos & mask)) difference_type(-difference_type(wrap_distance));
+            produce_pos += wrap_distance;
+        }
+
+        new (_buffer + (produce_pos & mask)) difference_type(difference_type(length));
+        if (callback(static_cast<void*>(_buffer + (produce_pos & mask) + sizeof(difference_type)))) {
+            _produce_pos.store(produce_pos + rounded_length, std::memory_order_release);
+            return true;
+        }
+
+        return false;
+    }
+
+    template<typename cbtype>
+    bool consume(size_t reader, cbtype callback) noexcept(noexcept(callback(static_cast<const void*>(nullptr), difference_type(0)))) {
+        reader_cursor& cursor = _readers[reader];
+        auto consume_pos = cursor._consume_pos.load(std::memory_order_relaxed);
+        auto produce_pos = cursor._produce_pos_cache;
+
+        if (produce_pos == consume_pos) {
+            produce_pos = cursor._produce_pos_cache = _produce_pos.load(std::memory_order_acquire);
+            if (produce_pos == consume_pos)
+                return false;
+        }
+
+        difference_type length;
+        memcpy(&length, _buffer + (consume_pos & mask), sizeof(length));
+
+        if (length < 0) {
+            consume_pos += -length;
+            memcpy(&length, _buffer + (consume_pos & mask), sizeof(length));
+        }
+
+        if (callback(static_cast<const void*>(_buffer + (consume_pos & mask) + sizeof(difference_type)), length)) {
+            auto rounded_length = ctu::round_up_bits(length + sizeof(difference_type), content_align_log2);
+            cursor._consume_pos.store(consume_pos + rounded_length, std::memory_order_release);
+            return true;
+        }
+
+        return false;
+    }
+
+    // returns true if buffer is empty for this reader after this call
+    template<typename cbtype>
+    bool consume_all(size_t reader, cbtype callback) noexcept(noexcept(callback(static_cast<const void*>(nullptr), difference_type(0)))) {
+        reader_cursor& cursor = _readers[reader];
+        auto consume_pos = cursor._consume_pos.load(std::memory_order_relaxed);
+        auto produce_pos = cursor._produce_pos_cache = _produce_pos.load(std::memory_order_acquire);
+
+        if (produce_pos == consume_pos)
+            return true;
+
+        scope_guard g([&cursor, &consume_pos]() {
+            cursor._consume_pos.store(consume_pos, std::memory_order_release);
+        });
+
+        while (consume_pos != produce_pos) {
+            while (consume_pos != produce_pos) {
+                difference_type length;
+                memcpy(&length, _buffer + (consume_pos & mask), sizeof(length));
+
+                if (length < 0) {
+                    consume_pos += -length;
+                    memcpy(&length, _buffer + (consume_pos & mask), sizeof(length));
+                }
+
+                if (callback(static_cast<const void*>(_buffer + (consume_pos & mask) + sizeof(difference_type)), length) == false) {
+                    return false;
+                }
+
+                auto rounded_length = ctu::round_up_bits(length + sizeof(difference_type), content_align_log2);
+                consume_pos += rounded_length;
+            }
+
+            produce_pos = cursor._produce_pos_cache = _produce_pos.load(std::memory_order_acquire);
+        }
+
+        return (consume_pos == produce_pos);
+    }
+
+    bool is_empty(size_t reader) const noexcept {
+        auto produce_pos = _produce_pos.load(std::memory_order_acquire);
+        auto consume_pos = _readers[reader]._consume_pos.load(std::memory_order_acquire);
+
+        return produce_pos == consume_pos;
+    }
+
+    // true if every reader consumed every record
+    bool is_empty() const noexcept {
+        return _produce_pos.load(std::memory_order_acquire) == min_consume_pos();
+    }
+
+private:
+    struct alignas(align) reader_cursor {
+        std::atomic<size_t> _consume_pos = 0;
+        mutable size_t _produce_pos_cache = 0;
+    };
+
+    // Positions only grow, so comparing distances to the producer handles
+    // wrap-around of size_t.
+    size_t min_consume_pos() const noexcept {
+        auto produce_pos = _produce_pos.load(std::memory_order_relaxed);
+        auto result = _readers[0]._consume_pos.load(std::memory_order_acquire);
+        for (size_t i = 1; i < _reader_count; i += 1) {
+            auto consume_pos = _readers[i]._consume_pos.load(std::memory_order_acquire);
+            if ((produce_pos - consume_pos) > (produce_pos - result)) {
+                result = consume_pos;
+            }
+        }
+        return result;
+    }
+
+    alignas(align) std::byte _buffer[size]{};
+
+    alignas(align) std::atomic<size_t> _produce_pos = 0;
+    mutable size_t _min_consume_pos_cache = 0;
+    const size_t _reader_count;
+
+    reader_cursor _readers[max_readers];
+};
@@ -1,20 +1,25 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <cstddef>
 #include <cstring>
+#include <iterator>
+#include <memory>
 #include <type_traits>
 #include <utility>
 #include "scope_guard.hpp"
 #include "compile_time_utilities.hpp"
+#include "wait_strategy.hpp"
 
-template<typename T, int _queue_size_log2, int _align_log2 = 7>
+template<typename T, int _queue_size_log2, int _align_log2 = 7, typename _wait_strategy = busy_spin_wait>
 struct alignas((size_t) 1 << _align_log2) spsc_queue {
     using value_type = T;
     static const auto size = size_t(1) << _queue_size_log2;
     static const auto mask = size - 1;
     static const auto align = size_t(1) << _align_log2;
+    using wait_strategy = _wait_strategy;
 
     spsc_queue() = default;
 
@@ -105,9 +110,17 @@ struct alignas((size_t) 1 << _align_log2) spsc_queue {
         new(_buffer + produce_pos * sizeof(value_type)) value_type(std::forward<Args>(args)...);
 
         _produce_pos.store(next_index, std::memory_order_release);
+        _not_empty.notify();
         return true;
     }
 
+    // blocks until the element was produced, see wait_strategy.hpp
+    template<typename... Args>
+    void produce_wait(Args&&... args) noexcept(std::is_nothrow_constructible_v<value_type, Args...>) {
+        // produce only forwards args once it is sure to succeed
+        _not_full.wait([&] { return this->produce(std::forward<Args>(args)...); });
+    }
+
     template<typename callable>
     bool consume(callable&& callback) noexcept(noexcept(callback(static_cast<value_type*>(nullptr)))) {
         auto consume_pos = _consume_pos.load(std::memory_order_relaxed);
@@ -127,6 +140,7 @@ struct alignas((size_t) 1 << _align_log2) spsc_queue {
             }
 
             _consume_pos.store(next_index, std::memory_order_release);
+            _not_full.notify();
 
             return true;
         }
@@ -134,6 +148,12 @@ struct alignas((size_t) 1 << _align_log2) spsc_queue {
         return false;
     }
 
+    // blocks until an element was consumed, callback must accept it
+    template<typename callable>
+    void consume_wait(callable&& callback) noexcept(noexcept(callback(static_cast<value_type*>(nullptr)))) {
+        _not_empty.wait([&] { return this->consume(callback); });
+    }
+
     // returns true if buffer is empty after this call
     template<typename callable>
     ptrdiff_t consume_all(callable&& callback) noexcept(noexcept(callback(static_cast<value_type*>(nullptr)))) {
@@ -145,6 +165,7 @@ struct alignas((size_t) 1 << _align_log2) spsc_queue {
 
         scope_guard g([this, &consume_pos] {
             _consume_pos.store(consume_pos, std::memory_order_release);
+            _not_full.notify();
         });
 
         auto old_consume_pos = consume_pos;
@@ -177,15 +198,18 @@ struct alignas((size_t) 1 << _align_log2) spsc_queue {
 private:
     alignas(align) std::byte _buffer[size * sizeof(T)];
     alignas(align) std::atomic<size_t> _produce_pos = 0;
+    wait_strategy _not_empty;
     alignas(align) std::atomic<size_t> _consume_pos = 0;
+    wait_strategy _not_full;
 };
 
-template<typename T, int _queue_size_log2, int _align_log2 = 7>
+template<typename T, int _queue_size_log2, int _align_log2 = 7, typename _wait_strategy = busy_spin_wait>
 struct alignas((size_t) 1 << _align_log2) spsc_queue_cached {
     using value_type = T;
     static const auto size = size_t(1) << _queue_size_log2;
     static const auto mask = size - 1;
     static const auto align = size_t(1) << _align_log2;
+    using wait_strategy = _wait_strategy;
 
     spsc_queue_cached() = default;
 
@@ -283,9 +307,55 @@ struct alignas((size_t) 1 << _align_log2) spsc_queue_cached {
         new(_buffer + produce_pos * sizeof(value_type)) value_type(std::forward<Args>(args)...);
 
         _produce_pos.store(next_index, std::memory_order_release);
+        _not_empty.notify();
         return true;
     }
 
+    // blocks until the element was produced, see wait_strategy.hpp
+    template<typename... Args>
+    void produce_wait(Args&&... args) noexcept(std::is_nothrow_constructible_v<value_type, Args...>) {
+        // produce only forwards args once it is sure to succeed
+        _not_full.wait([&] { return this->produce(std::forward<Args>(args)...); });
+    }
+
+    // constructs elements from [first, last) in the free slots, as long as
+    // there are any, and publishes the new produce position only once
+    // returns the number of elements produced
+    template<typename Iterator>
+    size_t produce_n(Iterator first, Iterator last) noexcept(std::is_nothrow_constructible_v<value_type, typename std::iterator_traits<Iterator>::reference>) {
+        static_assert(
+            std::is_constructible_v<value_type, typename std::iterator_traits<Iterator>::reference>,
+            "value_type must be constructible from Iterator::reference"
+        );
+
+        auto count = size_t(std::distance(first, last));
+        auto produce_pos = _produce_pos.load(std::memory_order_relaxed);
+        auto consume_pos = _consume_pos_cache;
+
+        auto free = (consume_pos - produce_pos - 1) & mask;
+        if (free < count) {
+            consume_pos = _consume_pos_cache = _consume_pos.load(std::memory_order_acquire);
+            free = (consume_pos - produce_pos - 1) & mask;
+            if (free < count) {
+                count = free;
+            }
+        }
+
+        if (count == 0) {
+            return 0;
+        }
+
+        // the free slots might wrap around the end of the buffer
+        auto first_run = std::min(count, size - produce_pos);
+        auto mid = std::next(first, first_run);
+        std::uninitialized_copy(first, mid, (value_type*)_buffer + produce_pos);
+        std::uninitialized_copy(mid, std::next(mid, count - first_run), (value_type*)_buffer);
+
+        _produce_pos.store((produce_pos + count) & mask, std::memory_order_release);
+        _not_empty.notify();
+        return count;
+    }
+
     template<typename callable>
     bool consume(callable&& callback) noexcept(noexcept(callback(static_cast<value_type*>(nullptr)))) {
         auto consume_pos = _consume_pos.load(std::memory_order_relaxed);
@@ -308,13 +378,68 @@ struct alignas((size_t) 1 << _align_log2) spsc_queue_cached {
             }
 
             _consume_pos.store(next_index, std::memory_order_release);
-            
+            _not_full.notify();
+
             return true;
         }
 
         return false;
     }
 
+    // blocks until an element was consumed, callback must accept it
+    template<typename callable>
+    void consume_wait(callable&& callback) noexcept(noexcept(callback(static_cast<value_type*>(nullptr)))) {
+        _not_empty.wait([&] { return this->consume(callback); });
+    }
+
+    // passes up to max elements to callback until it returns false, and
+    // publishes the new consume position only once
+    // returns the number of elements consumed
+    template<typename callable>
+    size_t consume_n(callable&& callback, size_t max) noexcept(noexcept(callback(static_cast<value_type*>(nullptr)))) {
+        auto consume_pos = _consume_pos.load(std::memory_order_relaxed);
+        auto produce_pos = _produce_pos_cache;
+
+        auto available = (produce_pos - consume_pos) & mask;
+        if (available < max) {
+            produce_pos = _produce_pos_cache = _produce_pos.load(std::memory_order_acquire);
+            available = (produce_pos - consume_pos) & mask;
+            if (available < max) {
+                max = available;
+            }
+        }
+
+        size_t count = 0;
+        if (max == 0) {
+            return count;
+        }
+
+        scope_guard g([this, consume_pos, &count] {
+            _consume_pos.store((consume_pos + count) & mask, std::memory_order_release);
+            _not_full.notify();
+        });
+
+        // the elements might wrap around the end of the buffer
+        auto first_run = std::min(max, size - consume_pos);
+        auto elem = (value_type*)_buffer + consume_pos;
+        for (; count < first_run; count += 1, elem += 1) {
+            if (callback(elem) == false) {
+                return count;
+            }
+            elem->~value_type();
+        }
+
+        elem = (value_type*)_buffer;
+        for (; count < max; count += 1, elem += 1) {
+            if (callback(elem) == false) {
+                return count;
+            }
+            elem->~value_type();
+        }
+
+        return count;
+    }
+
     // returns true if buffer is empty after this call
     template<typename callable>
     ptrdiff_t consume_all(callable&& callback) noexcept(noexcept(callback(static_cast<value_type*>(nullptr)))) {
@@ -326,6 +451,7 @@ struct alignas((size_t) 1 << _align_log2) spsc_queue_cached {
 
         scope_guard g([this, &consume_pos] {
             _consume_pos.store(consume_pos, std::memory_order_release);
+            _not_full.notify();
         });
 
         auto old_consume_pos = consume_pos;
@@ -360,9 +486,11 @@ private:
 
     alignas(align) std::atomic<size_t> _produce_pos = 0;
     mutable size_t _consume_pos_cache = 0;
+    wait_strategy _not_empty;
 
     alignas(align) std::atomic<size_t> _consume_pos = 0;
     mutable size_t _produce_pos_cache = 0;
+    wait_strategy _not_full;
 };
 
 template<typename T, int _queue_size, int _l1d_size_log2 = 15, int _align_log2 = 7>
@@ -867,58 +995,92 @@ private:
     mutable value_type* _produce_pos_cache = nullptr;
 };
 
+// Storage policies of spsc_queue_chunked_ptr. inline_chunks keeps the chunks
+// in the queue object and spreads _queue_size slots evenly over as few chunks
+// as hold them. heap_chunks in spsc_queue_heap.hpp allocates them instead.
+struct inline_chunks {
+    static constexpr size_t chunk_size(size_t queue_size, size_t chunk_max_size) {
+        auto count = (queue_size + chunk_max_size - 1) / chunk_max_size;
+        return (queue_size / count) + (((queue_size % count) == 0) ? 0 : 1);
+    }
+
+    template<typename chunk, size_t count>
+    struct storage {
+        explicit storage(size_t) {}
+
+        chunk* data() noexcept {
+            return _chunks.data();
+        }
+
+        const chunk* data() const noexcept {
+            return _chunks.data();
+        }
+
+        size_t size() const noexcept {
+            return count;
+        }
+
+        std::array<chunk, count> _chunks{};
+    };
+};
+
 template<
     typename T,
     size_t _queue_size,
     size_t _chunk_size_bytes = (1 << 15), // should not exceed L1D size of target arch
-    int _align_log2 = 7>
+    int _align_log2 = 7,
+    typename _wait_strategy = busy_spin_wait,
+    typename _storage_policy = inline_chunks>
 struct alignas((size_t)1 << _align_log2) spsc_queue_chunked_ptr {
     using value_type = T;
 
     static const auto size = _queue_size;
     static const auto align = size_t(1) << _align_log2;
+    using wait_strategy = _wait_strategy;
+    using storage_policy = _storage_policy;
     static const auto chunk_size_bytes = _chunk_size_bytes - (3 * align); // correct for chunk overhead, which is 3 cache lines
-    
+
     static_assert(_chunk_size_bytes > 4 * align, "Chunk size too small");
     static_assert(sizeof(value_type) <= chunk_size_bytes, "Elements must not be larger than effective chunk size");
     static_assert(alignof(value_type) <= align, "Elements must not have stronger alignment requirements than this queue");
 
     static const auto chunk_max_size = chunk_size_bytes / sizeof(value_type);
-    static const auto chunk_count = ((size + chunk_max_size - 1) / chunk_max_size);
-    static const auto chunk_size = (size / chunk_count) + (((size % chunk_count) == 0) ? 0 : 1);
+    static const auto chunk_size = storage_policy::chunk_size(size, chunk_max_size);
 
-    spsc_queue_chunked_ptr() : 
-        _chunks{},
+    static constexpr size_t chunks_for(size_t capacity) {
+        return capacity <= chunk_size ? 1 : (capacity + chunk_size - 1) / chunk_size;
+    }
+
+    static const auto chunk_count = chunks_for(size);
+
+    spsc_queue_chunked_ptr() : spsc_queue_chunked_ptr(size) {
+        static_assert(size > 0, "Queues with heap_chunks take their capacity as a constructor argument");
+    }
+
+    // capacity is rounded up to a multiple of chunk_size. inline_chunks
+    // ignores it and always holds chunk_count chunks.
+    explicit spsc_queue_chunked_ptr(size_t capacity) :
+        _chunks(chunks_for(capacity)),
         _head(_chunks.data()),
         _tail(_chunks.data())
     {
-        for (size_t i = 0; i < chunk_count - 1; i += 1) {
-            _chunks[i]._next = &_chunks[i + 1];
-        }
-        _chunks[chunk_count - 1]._next = _chunks.data();
+        link_chunks();
     }
 
     spsc_queue_chunked_ptr(const spsc_queue_chunked_ptr& other) :
         _chunks(other._chunks),
-        _head(_chunks + (other._head - other._chunks.data())),
-        _tail(_chunks + (other._tail - other._chunks.data()))
+        _head(_chunks.data() + (other._head - other._chunks.data())),
+        _tail(_chunks.data() + (other._tail - other._chunks.data()))
     {
-        for (size_t i = 0; i < chunk_count - 1; i += 1) {
-            _chunks[i]._next = &_chunks[i + 1];
-        }
-        _chunks[chunk_count - 1]._next = _chunks.data();
+        link_chunks();
     }
 
     spsc_queue_chunked_ptr& operator=(const spsc_queue_chunked_ptr& other) {
         _chunks = other._chunks;
+        link_chunks();
 
-        for (size_t i = 0; i < chunk_count - 1; i += 1) {
-            _chunks[i]._next = &_chunks[i + 1];
-        }
-        _chunks[chunk_count - 1]._next = _chunks.data();
-
-        _head = &_chunks[other._head - other._chunks.data()];
-        _tail = &_chunks[other._tail - other._chunks.data()];
+        _head = _chunks.data() + (other._head - other._chunks.data());
+        _tail = _chunks.data() + (other._tail - other._chunks.data());
 
         return *this;
     }
@@ -944,7 +1106,7 @@ struct alignas((size_t)1 << _align_log2) spsc_queue_chunked_ptr {
                 new(dst) value_type(*src);
                 ++dst;
                 ++src;
-                if (dst == (value_type*)_buffer + size) {
+                if (dst == (value_type*)_buffer + chunk_size) {
                     dst = (value_type*)_buffer;
                     src = (value_type*)other._buffer;
                 }
@@ -960,7 +1122,7 @@ struct alignas((size_t)1 << _align_log2) spsc_queue_chunked_ptr {
                 while (cur != end) {
                     cur->~value_type();
                     ++cur;
-                    if (cur == (value_type*)_buffer + size) {
+                    if (cur == (value_type*)_buffer + chunk_size) {
                         cur = (value_type*)_buffer;
                     }
                 }
@@ -979,7 +1141,7 @@ struct alignas((size_t)1 << _align_log2) spsc_queue_chunked_ptr {
                     new(dst) value_type(*src);
                     ++dst;
                     ++src;
-                    if (dst == (value_type*)_buffer + size) {
+                    if (dst == (value_type*)_buffer + chunk_size) {
                         dst = (value_type*)_buffer;
                         src = (value_type*)other._buffer;
                     }
@@ -995,7 +1157,7 @@ struct alignas((size_t)1 << _align_log2) spsc_queue_chunked_ptr {
             while (cur != end) {
                 cur->~value_type();
                 ++cur;
-                if (cur == (value_type*)_buffer + size) {
+                if (cur == (value_type*)_buffer + chunk_size) {
                     cur = (value_type*)_buffer;
                 }
             }
@@ -1057,16 +1219,25 @@ struct alignas((size_t)1 << _align_log2) spsc_queue_chunked_ptr {
                 new(produce_pos) value_type(std::forward<Args>(args)...);
                 head->_produce_pos.store(next_index, std::memory_order_release);
                 _head.store(head, std::memory_order_release);
+                _not_empty.notify();
                 return true;
             }
         }
 
         new(produce_pos) value_type(std::forward<Args>(args)...);
         head->_produce_pos.store(next_index, std::memory_order_release);
+        _not_empty.notify();
 
         return true;
     }
 
+    // blocks until the element was produced, see wait_strategy.hpp
+    template<typename... Args>
+    void produce_wait(Args&&... args) noexcept(std::is_nothrow_constructible_v<value_type, Args...>) {
+        // produce only forwards args once it is sure to succeed
+        _not_full.wait([&] { return this->produce(std::forward<Args>(args)...); });
+    }
+
     bool push(const value_type& e) {
         return this->produce(e);
     }
@@ -1115,6 +1286,9 @@ struct alignas((size_t)1 << _align_log2) spsc_queue_chunked_ptr {
                     }
 
                     _tail.store(tail, std::memory_order_release);
+                    if (result) {
+                        _not_full.notify();
+                    }
 
                     return result;
                 }
@@ -1129,12 +1303,19 @@ struct alignas((size_t)1 << _align_log2) spsc_queue_chunked_ptr {
                 consume_pos = (value_type*)tail->_buffer;
             }
             tail->_consume_pos.store(consume_pos, std::memory_order_release);
+            _not_full.notify();
             return true;
         }
 
         return false;
     }
 
+    // blocks until an element was consumed, callback must accept it
+    template<typename callable>
+    void consume_wait(callable&& callback) noexcept(noexcept(callback(std::declval<value_type&>()))) {
+        _not_empty.wait([&] { return this->consume(callback); });
+    }
+
     bool pop(value_type& e) {
         auto tail = _tail.load(std::memory_order_relaxed);
 
@@ -1171,6 +1352,7 @@ struct alignas((size_t)1 << _align_log2) spsc_queue_chunked_ptr {
                     tail->_consume_pos.store(consume_pos, std::memory_order_release);
 
                     _tail.store(tail, std::memory_order_release);
+                    _not_full.notify();
 
                     return true;
                 }
@@ -1185,6 +1367,7 @@ struct alignas((size_t)1 << _align_log2) spsc_queue_chunked_ptr {
             consume_pos = (value_type*)tail->_buffer;
         }
         tail->_consume_pos.store(consume_pos, std::memory_order_release);
+        _not_full.notify();
         return true;
     }
 
@@ -1196,6 +1379,7 @@ struct alignas((size_t)1 << _align_log2) spsc_queue_chunked_ptr {
 
         scope_guard g([this, &tail] {
             this->_tail.store(tail, std::memory_order_release);
+            this->_not_full.notify();
         });
 
         ptrdiff_t sum_consumed = 0;
@@ -1266,8 +1450,19 @@ struct alignas((size_t)1 << _align_log2) spsc_queue_chunked_ptr {
     }
 
 private:
-    alignas(align) std::array<chunk, chunk_count> _chunks{};
+    void link_chunks() noexcept {
+        auto chunks = _chunks.data();
+        for (size_t i = 0; i < _chunks.size() - 1; i += 1) {
+            chunks[i]._next = &chunks[i + 1];
+        }
+        chunks[_chunks.size() - 1]._next = chunks;
+    }
+
+    // read by both sides, never written after construction
+    alignas(align) typename storage_policy::template storage<chunk, chunk_count> _chunks;
     alignas(align) std::atomic<chunk*> _head = nullptr;
+    wait_strategy _not_empty;
     alignas(align) std::atomic<chunk*> _tail = nullptr;
+    wait_strategy _not_full;
 };
 
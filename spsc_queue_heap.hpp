@@ -0,0 +1,239 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "aligned_alloc.hpp"
+#include "scope_guard.hpp"
+#include "spsc_queue.hpp"
+#include "wait_strategy.hpp"
+
+// spsc_queue with the number of slots chosen at runtime. The slots are
+// allocated through _allocator, see aligned_allocator. Like spsc_queue, it
+// holds at most size - 1 elements.
+template<
+    typename T,
+    typename _allocator = aligned_allocator,
+    int _align_log2 = 7,
+    typename _wait_strategy = busy_spin_wait>
+struct alignas((size_t) 1 << _align_log2) spsc_queue_heap {
+    using value_type = T;
+    using allocator = _allocator;
+    using wait_strategy = _wait_strategy;
+    static const auto align = size_t(1) << _align_log2;
+
+    static_assert(alignof(value_type) <= align, "Elements must not have stronger alignment requirements than this queue");
+
+    explicit spsc_queue_heap(size_t size) :
+        _buffer(static_cast<std::byte*>(allocator::allocate(align, (size < 2 ? 2 : size) * sizeof(value_type)))),
+        _size(size < 2 ? 2 : size)
+    {
+        if (_buffer == nullptr) {
+            throw std::bad_alloc();
+        }
+    }
+
+    spsc_queue_heap(const spsc_queue_heap&) = delete;
+    spsc_queue_heap& operator=(const spsc_queue_heap&) = delete;
+
+    ~spsc_queue_heap() {
+        auto cur = (value_type*)_buffer + _consume_pos.load();
+        auto end = (value_type*)_buffer + _produce_pos.load();
+        while (cur != end) {
+            cur->~value_type();
+            ++cur;
+            if (cur == (value_type*)_buffer + _size) {
+                cur = (value_type*)_buffer;
+            }
+        }
+
+        allocator::deallocate(_buffer, _size * sizeof(value_type));
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+    template<typename... Args>
+    bool produce(Args&&... args) noexcept(std::is_nothrow_constructible_v<value_type, Args...>) {
+        static_assert(
+            std::is_constructible_v<value_type, Args...>,
+            "value_type must be constructible from Args..."
+        );
+
+        auto produce_pos = _produce_pos.load(std::memory_order_relaxed);
+        auto next_index = produce_pos + 1;
+        if (next_index == _size) {
+            next_index = 0;
+        }
+
+        auto consume_pos = _consume_pos.load(std::memory_order_acquire);
+        if (next_index == consume_pos) {
+            return false;
+        }
+
+        new(_buffer + produce_pos * sizeof(value_type)) value_type(std::forward<Args>(args)...);
+
+        _produce_pos.store(next_index, std::memory_order_release);
+        _not_empty.notify();
+        return true;
+    }
+
+    // blocks until the element was produced, see wait_strategy.hpp
+    template<typename... Args>
+    void produce_wait(Args&&... args) noexcept(std::is_nothrow_constructible_v<value_type, Args...>) {
+        // produce only forwards args once it is sure to succeed
+        _not_full.wait([&] { return this->produce(std::forward<Args>(args)...); });
+    }
+
+    template<typename callable>
+    bool consume(callable&& callback) noexcept(noexcept(callback(static_cast<value_type*>(nullptr)))) {
+        auto consume_pos = _consume_pos.load(std::memory_order_relaxed);
+        auto produce_pos = _produce_pos.load(std::memory_order_acquire);
+
+        if (produce_pos == consume_pos) {
+            return false;
+        }
+
+        value_type* elem = reinterpret_cast<value_type*>(_buffer + consume_pos * sizeof(value_type));
+        if (callback(elem)) {
+            elem->~value_type();
+
+            auto next_index = consume_pos + 1;
+            if (next_index == _size) {
+                next_index = 0;
+            }
+
+            _consume_pos.store(next_index, std::memory_order_release);
+            _not_full.notify();
+
+            return true;
+        }
+
+        return false;
+    }
+
+    // blocks until an element was consumed, callback must accept it
+    template<typename callable>
+    void consume_wait(callable&& callback) noexcept(noexcept(callback(static_cast<value_type*>(nullptr)))) {
+        _not_empty.wait([&] { return this->consume(callback); });
+    }
+
+    // returns the number of elements consumed
+    template<typename callable>
+    ptrdiff_t consume_all(callable&& callback) noexcept(noexcept(callback(static_cast<value_type*>(nullptr)))) {
+        auto consume_pos = _consume_pos.load(std::memory_order_acquire);
+        auto produce_pos = _produce_pos.load(std::memory_order_acquire);
+
+        if (produce_pos == consume_pos)
+            return 0;
+
+        scope_guard g([this, &consume_pos] {
+            _consume_pos.store(consume_pos, std::memory_order_release);
+            _not_full.notify();
+        });
+
+        auto old_consume_pos = consume_pos;
+
+        while (consume_pos != produce_pos) {
+            value_type* elem = reinterpret_cast<value_type*>(_buffer + consume_pos * sizeof(value_type));
+
+            if (callback(elem) == false) {
+                break;
+            }
+
+            elem->~value_type();
+
+            consume_pos += 1;
+            if (consume_pos == _size) {
+                consume_pos = 0;
+            }
+        }
+
+        if (consume_pos < old_consume_pos)
+            return ptrdiff_t(consume_pos + _size - old_consume_pos);
+        return ptrdiff_t(consume_pos - old_consume_pos);
+    }
+
+    bool is_empty() const {
+        auto consume_pos = _consume_pos.load(std::memory_order_acquire);
+        auto produce_pos = _produce_pos.load(std::memory_order_acquire);
+
+        return consume_pos == produce_pos;
+    }
+
+private:
+    // read by both sides, never written after construction
+    alignas(align) std::byte* const _buffer;
+    const size_t _size;
+
+    alignas(align) std::atomic<size_t> _produce_pos = 0;
+    wait_strategy _not_empty;
+    alignas(align) std::atomic<size_t> _consume_pos = 0;
+    wait_strategy _not_full;
+};
+
+// Storage policy of spsc_queue_chunked_ptr that allocates the chunks through
+// _allocator, see aligned_allocator. The number of chunks is chosen at
+// runtime, each chunk is filled up to its compile-time size.
+template<typename _allocator = aligned_allocator>
+struct heap_chunks {
+    using allocator = _allocator;
+
+    static constexpr size_t chunk_size(size_t, size_t chunk_max_size) {
+        return chunk_max_size;
+    }
+
+    template<typename chunk, size_t>
+    struct storage {
+        explicit storage(size_t count) :
+            _count(count),
+            _chunks(static_cast<chunk*>(allocator::allocate(alignof(chunk), count * sizeof(chunk))))
+        {
+            if (_chunks == nullptr) {
+                throw std::bad_alloc();
+            }
+
+            for (size_t i = 0; i < _count; i += 1) {
+                new(&_chunks[i]) chunk();
+            }
+        }
+
+        storage(const storage&) = delete;
+        storage& operator=(const storage&) = delete;
+
+        ~storage() {
+            for (size_t i = 0; i < _count; i += 1) {
+                _chunks[i].~chunk();
+            }
+
+            allocator::deallocate(_chunks, _count * sizeof(chunk));
+        }
+
+        chunk* data() const noexcept {
+            return _chunks;
+        }
+
+        size_t size() const noexcept {
+            return _count;
+        }
+
+    private:
+        const size_t _count;
+        chunk* const _chunks;
+    };
+};
+
+// spsc_queue_chunked_ptr with the number of chunks chosen at runtime. The
+// chunks keep their compile-time size, so the hot path is the same as for
+// spsc_queue_chunked_ptr, and the capacity passed to the constructor is
+// rounded up to a multiple of chunk_size.
+template<
+    typename T,
+    size_t _chunk_size_bytes = (1 << 15), // should not exceed L1D size of target arch
+    typename _allocator = aligned_allocator,
+    int _align_log2 = 7,
+    typename _wait_strategy = busy_spin_wait>
+using spsc_queue_chunked_ptr_heap = spsc_queue_chunked_ptr<T, 0, _chunk_size_bytes, _align_log2, _wait_strategy, heap_chunks<_allocator>>;
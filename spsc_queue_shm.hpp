@@ -0,0 +1,169 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "shared_memory.hpp"
+
+// spsc_queue for two processes. The queue and its elements live in one block
+// of memory, usually a shared_memory_segment, and only offsets from the start
+// of that block are stored, so every process can map it at a different
+// address. create constructs the queue in place, attach validates and returns
+// a queue created by another process. There is nothing to tear down, detaching
+// is unmapping the memory.
+//
+// Elements are copied between processes, so they have to be trivially
+// copyable. The capacity is set at runtime and must be a power of two.
+template<typename T, int _align_log2 = 7>
+struct alignas((size_t)1 << _align_log2) spsc_queue_shm {
+    using value_type = T;
+    static const auto align = size_t(1) << _align_log2;
+    static const uint64_t magic = shm_magic("SPSCQUEU");
+    static const uint32_t version = 1;
+
+    static_assert(std::is_trivially_copyable_v<value_type>, "Elements must be trivially copyable to cross process boundaries");
+    static_assert(alignof(value_type) <= align, "Elements must not have stronger alignment requirements than this queue");
+
+    // bytes of memory a queue with the given capacity occupies
+    static size_t required_size(size_t capacity) noexcept {
+        return sizeof(spsc_queue_shm) + capacity * sizeof(value_type);
+    }
+
+    // Constructs a queue at memory, which has to be aligned to align. Returns
+    // nullptr if capacity is not a power of two or memory is too small.
+    static spsc_queue_shm* create(void* memory, size_t memory_size, size_t capacity) noexcept {
+        if (capacity == 0 || (capacity & (capacity - 1)) != 0)
+            return nullptr;
+        if (memory_size < required_size(capacity) || (reinterpret_cast<uintptr_t>(memory) & (align - 1)) != 0)
+            return nullptr;
+
+        return new(memory) spsc_queue_shm(capacity);
+    }
+
+    // Returns the queue constructed at memory by create, possibly in another
+    // process, or nullptr if there is none or it was built with different
+    // parameters.
+    static spsc_queue_shm* attach(void* memory, size_t memory_size) noexcept {
+        if (memory_size < sizeof(spsc_queue_shm) || (reinterpret_cast<uintptr_t>(memory) & (align - 1)) != 0)
+            return nullptr;
+
+        auto queue = std::launder(static_cast<spsc_queue_shm*>(memory));
+        const shm_header& header = queue->_header;
+        if (header.magic.load(std::memory_order_acquire) != magic)
+            return nullptr;
+        if (header.version != version || header.layout != sizeof(value_type))
+            return nullptr;
+        if (memory_size < required_size(header.capacity))
+            return nullptr;
+
+        return queue;
+    }
+
+    spsc_queue_shm(const spsc_queue_shm&) = delete;
+    spsc_queue_shm& operator=(const spsc_queue_shm&) = delete;
+
+    size_t capacity() const noexcept {
+        return size_t(_header.capacity);
+    }
+
+    template<typename... Args>
+    bool produce(Args&&... args) noexcept(std::is_nothrow_constructible_v<value_type, Args...>) {
+        static_assert(
+            std::is_constructible_v<value_type, Args...>,
+            "value_type must be constructible from Args..."
+        );
+
+        auto produce_pos = _produce_pos.load(std::memory_order_relaxed);
+        if (produce_pos - _consume_pos_cache == _mask + 1) {
+            _consume_pos_cache = _consume_pos.load(std::memory_order_acquire);
+            if (produce_pos - _consume_pos_cache == _mask + 1)
+                return false;
+        }
+
+        new(buffer() + (produce_pos & _mask)) value_type(std::forward<Args>(args)...);
+
+        _produce_pos.store(produce_pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    template<typename callable>
+    bool consume(callable&& callback) noexcept(noexcept(callback(static_cast<value_type*>(nullptr)))) {
+        auto consume_pos = _consume_pos.load(std::memory_order_relaxed);
+        if (consume_pos == _produce_pos_cache) {
+            _produce_pos_cache = _produce_pos.load(std::memory_order_acquire);
+            if (consume_pos == _produce_pos_cache)
+                return false;
+        }
+
+        if (callback(buffer() + (consume_pos & _mask))) {
+            _consume_pos.store(consume_pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        return false;
+    }
+
+    // returns the number of elements consumed
+    template<typename callable>
+    size_t consume_all(callable&& callback) noexcept(noexcept(callback(static_cast<value_type*>(nullptr)))) {
+        auto consume_pos = _consume_pos.load(std::memory_order_relaxed);
+        auto produce_pos = _produce_pos_cache = _produce_pos.load(std::memory_order_acquire);
+        auto old_consume_pos = consume_pos;
+
+        while (consume_pos != produce_pos) {
+            if (callback(buffer() + (consume_pos & _mask)) == false)
+                break;
+            consume_pos += 1;
+        }
+
+        if (consume_pos != old_consume_pos) {
+            _consume_pos.store(consume_pos, std::memory_order_release);
+        }
+        return consume_pos - old_consume_pos;
+    }
+
+    bool push(const value_type& e) noexcept {
+        return produce(e);
+    }
+
+    bool pop(value_type& e) noexcept {
+        return consume([&e](value_type* elem) {
+            e = *elem;
+            return true;
+        });
+    }
+
+    bool is_empty() const noexcept {
+        auto consume_pos = _consume_pos.load(std::memory_order_acquire);
+        auto produce_pos = _produce_pos.load(std::memory_order_acquire);
+
+        return consume_pos == produce_pos;
+    }
+
+private:
+    explicit spsc_queue_shm(size_t capacity) noexcept :
+        _mask(capacity - 1)
+    {
+        _header.version = version;
+        _header.layout = uint32_t(sizeof(value_type));
+        _header.capacity = capacity;
+        _header.magic.store(magic, std::memory_order_release);
+    }
+
+    // the elements directly follow the queue
+    value_type* buffer() noexcept {
+        return reinterpret_cast<value_type*>(reinterpret_cast<std::byte*>(this) + sizeof(spsc_queue_shm));
+    }
+
+    shm_header _header;
+    const size_t _mask;
+
+    alignas(align) std::atomic<size_t> _produce_pos = 0;
+    mutable size_t _consume_pos_cache = 0;
+
+    alignas(align) std::atomic<size_t> _consume_pos = 0;
+    mutable size_t _produce_pos_cache = 0;
+};
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "aligned_alloc.hpp"
+
+// Unbounded relative of spsc_queue_chunked_ptr. Instead of a fixed ring of
+// chunks, chunks form a list: the producer fills the chunk at _head and, once
+// it is full, links in a new one. The consumer drains the chunk at _tail and
+// returns it to a lock-free pool, from which the producer takes its next
+// chunk. Chunks are only allocated when the pool is empty, so once the queue
+// has grown to its working size, produce and consume do not allocate.
+//
+// Every chunk is filled exactly once before it goes back to the pool, so there
+// is no wrap-around within a chunk. The pool is a stack with the consumer as
+// the only pusher and the producer as the only popper, which rules out ABA.
+// produce only fails if a chunk cannot be allocated. is_empty may only be
+// called by the consumer.
+template<
+    typename T,
+    size_t _chunk_size_bytes = (1 << 15), // should not exceed L1D size of target arch
+    typename _allocator = aligned_allocator,
+    int _align_log2 = 7>
+struct alignas((size_t)1 << _align_log2) spsc_queue_chunked_unbounded {
+    using value_type = T;
+    using allocator = _allocator;
+
+    static const auto align = size_t(1) << _align_log2;
+    static const auto chunk_size_bytes = _chunk_size_bytes - (3 * align); // correct for chunk overhead, which is 3 cache lines
+
+    static_assert(_chunk_size_bytes > 4 * align, "Chunk size too small");
+    static_assert(sizeof(value_type) <= chunk_size_bytes, "Elements must not be larger than effective chunk size");
+    static_assert(alignof(value_type) <= align, "Elements must not have stronger alignment requirements than this queue");
+
+    static const auto chunk_size = chunk_size_bytes / sizeof(value_type);
+
+    // reserved_chunks are allocated up front, the first one is in use
+    // immediately, the others wait in the pool. Only the first one is
+    // required, the pool grows on demand if reserving the others fails.
+    explicit spsc_queue_chunked_unbounded(size_t reserved_chunks = 1) {
+        chunk* first = allocate_chunk();
+        if (first == nullptr)
+            throw std::bad_alloc();
+
+        _head = first;
+        _produce_pos = first->begin();
+        _tail = first;
+        _consume_pos = first->begin();
+        _produce_pos_cache = first->begin();
+
+        for (size_t i = 1; i < reserved_chunks; i += 1) {
+            chunk* c = allocate_chunk();
+            if (c == nullptr)
+                break;
+            release_chunk(c);
+        }
+    }
+
+    spsc_queue_chunked_unbounded(const spsc_queue_chunked_unbounded&) = delete;
+    spsc_queue_chunked_unbounded& operator=(const spsc_queue_chunked_unbounded&) = delete;
+
+    ~spsc_queue_chunked_unbounded() {
+        chunk* c = _tail;
+        auto cur = _consume_pos;
+        while (c != nullptr) {
+            auto end = c->_produce_pos.load();
+            while (cur != end) {
+                cur->~value_type();
+                ++cur;
+            }
+
+            chunk* next = c->_next.load();
+            c->~chunk();
+            allocator::deallocate(c, sizeof(chunk));
+            c = next;
+            if (c != nullptr) {
+                cur = c->begin();
+            }
+        }
+
+        c = _pool.load();
+        while (c != nullptr) {
+            chunk* next = c->_pool_next;
+            c->~chunk();
+            allocator::deallocate(c, sizeof(chunk));
+            c = next;
+        }
+    }
+
+    struct alignas(align) chunk {
+        value_type* begin() noexcept {
+            return reinterpret_cast<value_type*>(_buffer);
+        }
+
+        value_type* end() noexcept {
+            return begin() + chunk_size;
+        }
+
+        std::byte _buffer[chunk_size * sizeof(value_type)];
+
+        // written by the producer only
+        alignas(align) std::atomic<value_type*> _produce_pos = nullptr;
+        std::atomic<chunk*> _next = nullptr;
+
+        // written by the consumer, while the chunk is not in use
+        alignas(align) chunk* _pool_next = nullptr;
+    };
+
+    template<typename... Args>
+    bool produce(Args&&... args) noexcept(std::is_nothrow_constructible_v<value_type, Args...>) {
+        static_assert(
+            std::is_constructible_v<value_type, Args...>,
+            "value_type must be constructible from Args..."
+        );
+
+        auto head = _head;
+        auto produce_pos = _produce_pos;
+        if (produce_pos == head->end()) {
+            chunk* next = acquire_chunk();
+            if (next == nullptr)
+                return false;
+
+            // publishes the reset chunk as well
+            head->_next.store(next, std::memory_order_release);
+            _head = head = next;
+            produce_pos = next->begin();
+        }
+
+        new(produce_pos) value_type(std::forward<Args>(args)...);
+        _produce_pos = produce_pos + 1;
+        head->_produce_pos.store(produce_pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    template<typename callable>
+    bool consume(callable&& callback) noexcept(noexcept(callback(static_cast<value_type*>(nullptr)))) {
+        auto tail = _tail;
+        auto consume_pos = _consume_pos;
+
+        if (consume_pos == _produce_pos_cache) {
+            _produce_pos_cache = tail->_produce_pos.load(std::memory_order_acquire);
+            if (consume_pos == _produce_pos_cache) {
+                if (consume_pos != tail->end())
+                    return false;
+
+                chunk* next = tail->_next.load(std::memory_order_acquire);
+                if (next == nullptr)
+                    return false;
+
+                // the producer moved on to next and never touches tail again
+                release_chunk(tail);
+                _tail = tail = next;
+                _consume_pos = consume_pos = next->begin();
+                _produce_pos_cache = next->_produce_pos.load(std::memory_order_acquire);
+                if (consume_pos == _produce_pos_cache)
+                    return false;
+            }
+        }
+
+        if (callback(consume_pos)) {
+            consume_pos->~value_type();
+            _consume_pos = consume_pos + 1;
+            return true;
+        }
+
+        return false;
+    }
+
+    bool push(const value_type& e) noexcept(std::is_nothrow_copy_constructible_v<value_type>) {
+        return produce(e);
+    }
+
+    bool pop(value_type& e) noexcept(std::is_nothrow_move_assignable_v<value_type>) {
+        return consume([&e](value_type* elem) {
+            e = std::move(*elem);
+            return true;
+        });
+    }
+
+    bool is_empty() const {
+        auto tail = _tail;
+        if (_consume_pos != tail->_produce_pos.load(std::memory_order_acquire))
+            return false;
+
+        chunk* next = tail->_next.load(std::memory_order_acquire);
+        return next == nullptr || next->_produce_pos.load(std::memory_order_acquire) == next->begin();
+    }
+
+    // chunks allocated so far, read by the producer
+    size_t allocated_chunks() const noexcept {
+        return _allocated_chunks;
+    }
+
+private:
+    chunk* allocate_chunk() noexcept {
+        void* memory = allocator::allocate(align, sizeof(chunk));
+        if (memory == nullptr)
+            return nullptr;
+
+        _allocated_chunks += 1;
+        chunk* c = new(memory) chunk();
+        c->_produce_pos.store(c->begin(), std::memory_order_relaxed);
+        return c;
+    }
+
+    // producer side, takes a chunk from the pool or allocates a new one
+    chunk* acquire_chunk() noexcept {
+        chunk* c = _pool.load(std::memory_order_acquire);
+        while (c != nullptr && _pool.compare_exchange_weak(c, c->_pool_next, std::memory_order_acquire, std::memory_order_acquire) == false) {}
+
+        if (c == nullptr)
+            return allocate_chunk();
+
+        c->_produce_pos.store(c->begin(), std::memory_order_relaxed);
+        c->_next.store(nullptr, std::memory_order_relaxed);
+        return c;
+    }
+
+    // consumer side
+    void release_chunk(chunk* c) noexcept {
+        c->_pool_next = _pool.load(std::memory_order_relaxed);
+        while (_pool.compare_exchange_weak(c->_pool_next, c, std::memory_order_release, std::memory_order_relaxed) == false) {}
+    }
+
+    alignas(align) chunk* _head = nullptr;
+    value_type* _produce_pos = nullptr;
+    size_t _allocated_chunks = 0;
+
+    alignas(align) chunk* _tail = nullptr;
+    value_type* _consume_pos = nullptr;
+    value_type* _produce_pos_cache = nullptr;
+
+    alignas(align) std::atomic<chunk*> _pool = nullptr;
+};
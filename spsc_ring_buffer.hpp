@@ -7,13 +7,51 @@
 #include <limits>
 #include "aligned_alloc.hpp"
 #include "compile_time_utilities.hpp"
+#include "drain_result.hpp"
 #include "scope_guard.hpp"
 
+// Index policies of spsc_ring_buffer and spsc_ring_buffer_masked, for how each
+// side reads the position of the other. uncached_index loads it for every
+// record, moving its cache line between the cores each time. cached_index
+// keeps the value it loaded last in a field next to the own position and only
+// reloads when that value says the buffer is full (producer) or empty
+// (consumer), like spsc_ring_buffer_cached.
+struct uncached_index {
+    static size_t known(const std::atomic<size_t>& pos, size_t&) noexcept {
+        return pos.load(std::memory_order_acquire);
+    }
+
+    // stores a fresh value in value if known may have returned an outdated one
+    static bool reload(const std::atomic<size_t>&, size_t&, size_t&) noexcept {
+        return false;
+    }
+
+    static size_t load(const std::atomic<size_t>& pos, size_t&) noexcept {
+        return pos.load(std::memory_order_acquire);
+    }
+};
+
+struct cached_index {
+    static size_t known(const std::atomic<size_t>&, size_t& cache) noexcept {
+        return cache;
+    }
+
+    static bool reload(const std::atomic<size_t>& pos, size_t& cache, size_t& value) noexcept {
+        value = cache = pos.load(std::memory_order_acquire);
+        return true;
+    }
+
+    static size_t load(const std::atomic<size_t>& pos, size_t& cache) noexcept {
+        return cache = pos.load(std::memory_order_acquire);
+    }
+};
+
 template<
     int _buffer_size_log2,
     int _content_align_log2 = ctu::log2_v<sizeof(void*)>,
     typename _difference_type = ptrdiff_t,
-    int _align_log2 = 7
+    int _align_log2 = 7,
+    typename _index_policy = uncached_index
 >
 struct alignas(((size_t) 1) << _align_log2) spsc_ring_buffer {
     using difference_type = _difference_type;
@@ -21,6 +59,7 @@ struct alignas(((size_t) 1) << _align_log2) spsc_ring_buffer {
     static const auto mask = ctu::bit_mask_v<size_t, _buffer_size_log2>;
     static const auto align = size_t(1) << _align_log2;
     static const auto content_align_log2 = _content_align_log2;
+    using index_policy = _index_policy;
 
     static_assert(std::is_signed_v<difference_type>);
     static_assert(content_align_log2 >= ctu::log2(sizeof(difference_type)));
@@ -37,19 +76,27 @@ struct alignas(((size_t) 1) << _align_log2) spsc_ring_buffer {
                 return false;
         }
 
-        auto consume_pos = _consume_pos.load(std::memory_order_acquire);
+        auto consume_pos = index_policy::known(_consume_pos, _consume_pos_cache);
         auto produce_pos = _produce_pos.load(std::memory_order_relaxed);
 
-        auto fill_level = (produce_pos - consume_pos);
-        if (fill_level > size)
-            fill_level += size;
-        if (fill_level >= (size - rounded_length))
-            return false;
+        auto fill_level = fill_level_of(produce_pos, consume_pos);
+        if (fill_level >= (size - rounded_length)) {
+            if (index_policy::reload(_consume_pos, _consume_pos_cache, consume_pos) == false)
+                return false;
+            fill_level = fill_level_of(produce_pos, consume_pos);
+            if (fill_level >= (size - rounded_length))
+                return false;
+        }
 
         auto wrap_distance = size - produce_pos;
         if (wrap_distance < rounded_length) {
-            if (fill_level + wrap_distance >= (size - rounded_length))
-                return false;
+            if (fill_level + wrap_distance >= (size - rounded_length)) {
+                if (index_policy::reload(_consume_pos, _consume_pos_cache, consume_pos) == false)
+                    return false;
+                fill_level = fill_level_of(produce_pos, consume_pos);
+                if (fill_level + wrap_distance >= (size - rounded_length))
+                    return false;
+            }
 
             new (_buffer + produce_pos) difference_type(-difference_type(wrap_distance));
             produce_pos = 0;
@@ -68,13 +115,86 @@ struct alignas(((size_t) 1) << _align_log2) spsc_ring_buffer {
         return false;
     }
 
+    // Two-phase alternative to produce. Reserves space for a record of up to
+    // max_length bytes and returns a pointer to it, or nullptr if there is not
+    // enough space. The record is not visible to the consumer before commit.
+    void* reserve(size_t max_length) noexcept {
+        if (max_length <= 0 || max_length >= size)
+            return nullptr;
+
+        auto rounded_length = ctu::round_up_bits(max_length + sizeof(difference_type), content_align_log2);
+
+        if constexpr (size >= size_t(std::numeric_limits<difference_type>::max())) {
+            if (rounded_length > size_t(std::numeric_limits<difference_type>::max()))
+                return nullptr;
+        }
+
+        auto consume_pos = index_policy::known(_consume_pos, _consume_pos_cache);
+        auto produce_pos = _produce_pos.load(std::memory_order_relaxed);
+
+        auto fill_level = fill_level_of(produce_pos, consume_pos);
+        if (fill_level >= (size - rounded_length)) {
+            if (index_policy::reload(_consume_pos, _consume_pos_cache, consume_pos) == false)
+                return nullptr;
+            fill_level = fill_level_of(produce_pos, consume_pos);
+            if (fill_level >= (size - rounded_length))
+                return nullptr;
+        }
+
+        auto wrap_distance = size - produce_pos;
+        if (wrap_distance < rounded_length) {
+            if (fill_level + wrap_distance >= (size - rounded_length)) {
+                if (index_policy::reload(_consume_pos, _consume_pos_cache, consume_pos) == false)
+                    return nullptr;
+                fill_level = fill_level_of(produce_pos, consume_pos);
+                if (fill_level + wrap_distance >= (size - rounded_length))
+                    return nullptr;
+            }
+
+            new (_buffer + produce_pos) difference_type(-difference_type(wrap_distance));
+            produce_pos = 0;
+        }
+
+        // commit relies on this header to tell whether the wrap marker above
+        // was written
+        new (_buffer + produce_pos) difference_type(difference_type(max_length));
+        return static_cast<void*>(_buffer + produce_pos + sizeof(difference_type));
+    }
+
+    // Publishes the record returned by the last call to reserve. length must
+    // not exceed the length passed to reserve. A length of 0 abandons the
+    // reservation.
+    void commit(size_t length) noexcept {
+        if (length <= 0)
+            return;
+
+        auto produce_pos = _produce_pos.load(std::memory_order_relaxed);
+
+        difference_type header;
+        memcpy(&header, _buffer + produce_pos, sizeof(header));
+        if (header < 0) {
+            produce_pos = 0;
+        }
+
+        new (_buffer + produce_pos) difference_type(difference_type(length));
+
+        auto rounded_length = ctu::round_up_bits(length + sizeof(difference_type), content_align_log2);
+        if (produce_pos + rounded_length == size) {
+            _produce_pos.store(0, std::memory_order_release);
+        } else {
+            _produce_pos.store(produce_pos + rounded_length, std::memory_order_release);
+        }
+    }
+
     template<typename cbtype>
     bool consume(cbtype callback) noexcept(noexcept(callback(static_cast<void*>(nullptr), difference_type(0)))) {
         auto consume_pos = _consume_pos.load(std::memory_order_relaxed);
-        auto produce_pos = _produce_pos.load(std::memory_order_acquire);
+        auto produce_pos = index_policy::known(_produce_pos, _produce_pos_cache);
 
-        if (produce_pos == consume_pos)
-            return false;
+        if (produce_pos == consume_pos) {
+            if (index_policy::reload(_produce_pos, _produce_pos_cache, produce_pos) == false || produce_pos == consume_pos)
+                return false;
+        }
 
         difference_type length;
         memcpy(&length, _buffer + consume_pos, sizeof(length));
@@ -97,11 +217,53 @@ struct alignas(((size_t) 1) << _align_log2) spsc_ring_buffer {
         return false;
     }
 
+    // Two-phase alternative to consume. Returns a pointer to the next record
+    // and stores its length in length, or returns nullptr if the buffer is
+    // empty. The record stays in the buffer until release is called.
+    void* peek(difference_type& length) noexcept {
+        auto consume_pos = _consume_pos.load(std::memory_order_relaxed);
+        auto produce_pos = index_policy::known(_produce_pos, _produce_pos_cache);
+
+        if (produce_pos == consume_pos) {
+            if (index_policy::reload(_produce_pos, _produce_pos_cache, produce_pos) == false || produce_pos == consume_pos)
+                return nullptr;
+        }
+
+        memcpy(&length, _buffer + consume_pos, sizeof(length));
+
+        if (length < 0) {
+            consume_pos = 0;
+            memcpy(&length, _buffer, sizeof(length));
+        }
+
+        return static_cast<void*>(_buffer + consume_pos + sizeof(difference_type));
+    }
+
+    // Removes the record returned by the last call to peek from the buffer.
+    void release() noexcept {
+        auto consume_pos = _consume_pos.load(std::memory_order_relaxed);
+
+        difference_type length;
+        memcpy(&length, _buffer + consume_pos, sizeof(length));
+
+        if (length < 0) {
+            consume_pos = 0;
+            memcpy(&length, _buffer, sizeof(length));
+        }
+
+        auto rounded_length = ctu::round_up_bits(length + sizeof(difference_type), content_align_log2);
+        if (consume_pos + rounded_length == size) {
+            _consume_pos.store(0, std::memory_order_release);
+        } else {
+            _consume_pos.store(consume_pos + rounded_length, std::memory_order_release);
+        }
+    }
+
     // returns true if buffer is empty after this call
     template<typename cbtype>
     bool consume_all(cbtype callback) noexcept(noexcept(callback(static_cast<void*>(nullptr), difference_type(0)))) {
         auto consume_pos = _consume_pos.load(std::memory_order_relaxed);
-        auto produce_pos = _produce_pos.load(std::memory_order_acquire);
+        auto produce_pos = index_policy::load(_produce_pos, _produce_pos_cache);
 
         if (produce_pos == consume_pos)
             return true;
@@ -126,17 +288,60 @@ struct alignas(((size_t) 1) << _align_log2) spsc_ring_buffer {
 
                 auto rounded_length = ctu::round_up_bits(length + sizeof(difference_type), content_align_log2);
                 consume_pos += rounded_length;
-                if (consume_pos = size) {
+                if (consume_pos == size) {
                     consume_pos = 0;
                 }
             }
 
-            produce_pos = _produce_pos.load(std::memory_order_acquire);
+            produce_pos = index_policy::load(_produce_pos, _produce_pos_cache);
         }
 
         return true;
     }
 
+    // Consumes the records available when it is called, up to the first one
+    // callback rejects. _consume_pos is published every publish_interval
+    // records, so the producer can reuse space while the drain goes on, and
+    // once at the end. 0 publishes only at the end.
+    template<typename cbtype>
+    drain_result drain(cbtype callback, size_t publish_interval = 64) noexcept(noexcept(callback(static_cast<void*>(nullptr), difference_type(0)))) {
+        drain_result result;
+        auto consume_pos = _consume_pos.load(std::memory_order_relaxed);
+        auto produce_pos = index_policy::load(_produce_pos, _produce_pos_cache);
+
+        size_t unpublished = 0;
+        while (consume_pos != produce_pos) {
+            difference_type length;
+            memcpy(&length, _buffer + consume_pos, sizeof(length));
+
+            if (length < 0) {
+                consume_pos = 0;
+                memcpy(&length, _buffer, sizeof(length));
+            }
+
+            if (callback(static_cast<void*>(_buffer + consume_pos + sizeof(difference_type)), length) == false)
+                break;
+
+            auto rounded_length = ctu::round_up_bits(length + sizeof(difference_type), content_align_log2);
+            consume_pos += rounded_length;
+            if (consume_pos == size) {
+                consume_pos = 0;
+            }
+            result.records += 1;
+            result.bytes += size_t(length);
+
+            if (++unpublished == publish_interval) {
+                _consume_pos.store(consume_pos, std::memory_order_release);
+                unpublished = 0;
+            }
+        }
+
+        if (unpublished > 0) {
+            _consume_pos.store(consume_pos, std::memory_order_release);
+        }
+        return result;
+    }
+
     bool is_empty() const noexcept {
         auto produce_pos = _produce_pos.load(std::memory_order_acquire);
         auto consume_pos = _consume_pos.load(std::memory_order_acquire);
@@ -145,6 +350,13 @@ struct alignas(((size_t) 1) << _align_log2) spsc_ring_buffer {
     }
 
 private:
+    static size_t fill_level_of(size_t produce_pos, size_t consume_pos) noexcept {
+        auto fill_level = (produce_pos - consume_pos);
+        if (fill_level > size)
+            fill_level += size;
+        return fill_level;
+    }
+
     alignas(align) std::byte _buffer[size]{};
 
     alignas(align) std::atomic<size_t> _produce_pos = 0;
@@ -158,7 +370,8 @@ template<
     int _buffer_size_log2,
     int _content_align_log2 = ctu::log2_v<sizeof(void*)>,
     typename _difference_type = ptrdiff_t,
-    int _align_log2 = 6
+    int _align_log2 = 6,
+    typename _index_policy = uncached_index
 >
 struct alignas(((size_t) 1) << _align_log2) spsc_ring_buffer_masked {
     using difference_type = _difference_type;
@@ -166,6 +379,7 @@ struct alignas(((size_t) 1) << _align_log2) spsc_ring_buffer_masked {
     static const auto mask = ctu::bit_mask_v<size_t, _buffer_size_log2>;
     static const auto align = size_t(1) << _align_log2;
     static const auto content_align_log2 = _content_align_log2;
+    using index_policy = _index_policy;
 
     static_assert(std::is_signed_v<difference_type>);
     static_assert(content_align_log2 >= ctu::log2(sizeof(difference_type)));
@@ -182,16 +396,24 @@ struct alignas(((size_t) 1) << _align_log2) spsc_ring_buffer_masked {
                 return false;
         }
 
-        auto consume_pos = _consume_pos.load(std::memory_order_acquire);
+        auto consume_pos = index_policy::known(_consume_pos, _consume_pos_cache);
         auto produce_pos = _produce_pos.load(std::memory_order_relaxed);
 
-        if ((produce_pos - consume_pos) > (size - rounded_length))
-            return false;
+        if ((produce_pos - consume_pos) > (size - rounded_length)) {
+            if (index_policy::reload(_consume_pos, _consume_pos_cache, consume_pos) == false)
+                return false;
+            if ((produce_pos - consume_pos) > (size - rounded_length))
+                return false;
+        }
 
         auto wrap_distance = size - (produce_pos & mask);
         if (wrap_distance < rounded_length) {
-            if ((produce_pos + wrap_distance - consume_pos) > (size - rounded_length))
-                return false;
+            if ((produce_pos + wrap_distance - consume_pos) > (size - rounded_length)) {
+                if (index_policy::reload(_consume_pos, _consume_pos_cache, consume_pos) == false)
+                    return false;
+                if ((produce_pos + wrap_distance - consume_pos) > (size - rounded_length))
+                    return false;
+            }
 
             new (_buffer + (produce_pos & mask)) difference_type(-difference_type(wrap_distance));
             produce_pos += wrap_distance;
@@ -209,10 +431,12 @@ struct alignas(((size_t) 1) << _align_log2) spsc_ring_buffer_masked {
     template<typename cbtype>
     bool consume(cbtype callback) noexcept(noexcept(callback(static_cast<void*>(nullptr), difference_type(0)))) {
         auto consume_pos = _consume_pos.load(std::memory_order_relaxed);
-        auto produce_pos = _produce_pos.load(std::memory_order_acquire);
+        auto produce_pos = index_policy::known(_produce_pos, _produce_pos_cache);
 
-        if (produce_pos == consume_pos)
-            return false;
+        if (produce_pos == consume_pos) {
+            if (index_policy::reload(_produce_pos, _produce_pos_cache, produce_pos) == false || produce_pos == consume_pos)
+                return false;
+        }
 
         difference_type length;
         memcpy(&length, _buffer + (consume_pos & mask), sizeof(length));
@@ -235,7 +459,7 @@ struct alignas(((size_t) 1) << _align_log2) spsc_ring_buffer_masked {
     template<typename cbtype>
     bool consume_all(cbtype callback) noexcept(noexcept(callback(static_cast<void*>(nullptr), difference_type(0)))) {
         auto consume_pos = _consume_pos.load(std::memory_order_relaxed);
-        auto produce_pos = _produce_pos.load(std::memory_order_acquire);
+        auto produce_pos = index_policy::load(_produce_pos, _produce_pos_cache);
 
         if (produce_pos == consume_pos)
             return true;
@@ -262,12 +486,52 @@ struct alignas(((size_t) 1) << _align_log2) spsc_ring_buffer_masked {
                 consume_pos += rounded_length;
             }
 
-            produce_pos = _produce_pos.load(std::memory_order_acquire);
+            produce_pos = index_policy::load(_produce_pos, _produce_pos_cache);
         }
 
         return (consume_pos == produce_pos);
     }
 
+    // Consumes the records available when it is called, up to the first one
+    // callback rejects. _consume_pos is published every publish_interval
+    // records, so the producer can reuse space while the drain goes on, and
+    // once at the end. 0 publishes only at the end.
+    template<typename cbtype>
+    drain_result drain(cbtype callback, size_t publish_interval = 64) noexcept(noexcept(callback(static_cast<void*>(nullptr), difference_type(0)))) {
+        drain_result result;
+        auto consume_pos = _consume_pos.load(std::memory_order_relaxed);
+        auto produce_pos = index_policy::load(_produce_pos, _produce_pos_cache);
+
+        size_t unpublished = 0;
+        while (consume_pos != produce_pos) {
+            difference_type length;
+            memcpy(&length, _buffer + (consume_pos & mask), sizeof(length));
+
+            if (length < 0) {
+                consume_pos += -length;
+                memcpy(&length, _buffer + (consume_pos & mask), sizeof(length));
+            }
+
+            if (callback(static_cast<void*>(_buffer + (consume_pos & mask) + sizeof(difference_type)), length) == false)
+                break;
+
+            auto rounded_length = ctu::round_up_bits(length + sizeof(difference_type), content_align_log2);
+            consume_pos += rounded_length;
+            result.records += 1;
+            result.bytes += size_t(length);
+
+            if (++unpublished == publish_interval) {
+                _consume_pos.store(consume_pos, std::memory_order_release);
+                unpublished = 0;
+            }
+        }
+
+        if (unpublished > 0) {
+            _consume_pos.store(consume_pos, std::memory_order_release);
+        }
+        return result;
+    }
+
     bool is_empty() const noexcept {
         auto produce_pos = _produce_pos.load(std::memory_order_acquire);
         auto consume_pos = _consume_pos.load(std::memory_order_acquire);
@@ -7,13 +7,16 @@
 #include <limits>
 #include "aligned_alloc.hpp"
 #include "compile_time_utilities.hpp"
+#include "drain_result.hpp"
 #include "scope_guard.hpp"
+#include "wait_strategy.hpp"
 
 template<
     int _buffer_size_log2,
     int _content_align_log2 = ctu::log2_v<sizeof(void*)>,
     typename _difference_type = ptrdiff_t,
-    int _align_log2 = 7
+    int _align_log2 = 7,
+    typename _wait_strategy = busy_spin_wait
 >
 struct alignas(((size_t)1) << _align_log2) spsc_ring_buffer_cached {
     using difference_type = _difference_type;
@@ -21,6 +24,7 @@ struct alignas(((size_t)1) << _align_log2) spsc_ring_buffer_cached {
     static const auto mask = ctu::bit_mask_v<size_t, _buffer_size_log2>;
     static const auto align = size_t(1) << _align_log2;
     static const auto content_align_log2 = _content_align_log2;
+    using wait_strategy = _wait_strategy;
 
     static_assert(std::is_signed_v<difference_type>);
     static_assert(content_align_log2 >= ctu::log2(sizeof(difference_type)));
@@ -71,12 +75,20 @@ struct alignas(((size_t)1) << _align_log2) spsc_ring_buffer_cached {
             } else {
                 _produce_pos.store(produce_pos + rounded_length, std::memory_order_release);
             }
+            _not_empty.notify();
             return true;
         }
 
         return false;
     }
 
+    // blocks until the record was produced, see wait_strategy.hpp
+    // callback must not fail
+    template<typename cbtype>
+    void produce_wait(size_t length, cbtype callback) noexcept(noexcept(callback(static_cast<void*>(nullptr)))) {
+        _not_full.wait([&] { return this->produce(length, callback); });
+    }
+
     template<typename cbtype>
     bool consume(cbtype callback) noexcept(noexcept(callback(static_cast<const void*>(nullptr), difference_type(0)))) {
         auto produce_pos = _produce_pos_cache;
@@ -103,12 +115,19 @@ struct alignas(((size_t)1) << _align_log2) spsc_ring_buffer_cached {
             } else {
                 _consume_pos.store(consume_pos + rounded_length, std::memory_order_release);
             }
+            _not_full.notify();
             return true;
         }
 
         return false;
     }
 
+    // blocks until a record was consumed, callback must accept it
+    template<typename cbtype>
+    void consume_wait(cbtype callback) noexcept(noexcept(callback(static_cast<const void*>(nullptr), difference_type(0)))) {
+        _not_empty.wait([&] { return this->consume(callback); });
+    }
+
     // returns true if buffer is empty after this call
     template<typename cbtype>
     bool consume_all(cbtype callback) noexcept(noexcept(callback(static_cast<const void*>(nullptr), difference_type(0)))) {
@@ -120,6 +139,7 @@ struct alignas(((size_t)1) << _align_log2) spsc_ring_buffer_cached {
 
         scope_guard g([this, &consume_pos]() {
             _consume_pos.store(consume_pos, std::memory_order_release);
+            _not_full.notify();
         });
 
         while (consume_pos != produce_pos) {
@@ -138,7 +158,7 @@ struct alignas(((size_t)1) << _align_log2) spsc_ring_buffer_cached {
 
                 auto rounded_length = ctu::round_up_bits(length + sizeof(difference_type), content_align_log2);
                 consume_pos += rounded_length;
-                if (consume_pos = size) {
+                if (consume_pos == size) {
                     consume_pos = 0;
                 }
             }
@@ -149,6 +169,52 @@ struct alignas(((size_t)1) << _align_log2) spsc_ring_buffer_cached {
         return true;
     }
 
+    // Consumes the records available when it is called, up to the first one
+    // callback rejects. _consume_pos is published every publish_interval
+    // records, so the producer can reuse space while the drain goes on, and
+    // once at the end. 0 publishes only at the end.
+    template<typename cbtype>
+    drain_result drain(cbtype callback, size_t publish_interval = 64) noexcept(noexcept(callback(static_cast<const void*>(nullptr), difference_type(0)))) {
+        drain_result result;
+        auto consume_pos = _consume_pos.load(std::memory_order_relaxed);
+        auto produce_pos = _produce_pos.load(std::memory_order_acquire);
+        _produce_pos_cache = produce_pos;
+
+        size_t unpublished = 0;
+        while (consume_pos != produce_pos) {
+            difference_type length;
+            memcpy(&length, _buffer + consume_pos, sizeof(length));
+
+            if (length < 0) {
+                consume_pos = 0;
+                memcpy(&length, _buffer, sizeof(length));
+            }
+
+            if (callback(static_cast<const void*>(_buffer + consume_pos + sizeof(difference_type)), length) == false)
+                break;
+
+            auto rounded_length = ctu::round_up_bits(length + sizeof(difference_type), content_align_log2);
+            consume_pos += rounded_length;
+            if (consume_pos == size) {
+                consume_pos = 0;
+            }
+            result.records += 1;
+            result.bytes += size_t(length);
+
+            if (++unpublished == publish_interval) {
+                _consume_pos.store(consume_pos, std::memory_order_release);
+                _not_full.notify();
+                unpublished = 0;
+            }
+        }
+
+        if (unpublished > 0) {
+            _consume_pos.store(consume_pos, std::memory_order_release);
+            _not_full.notify();
+        }
+        return result;
+    }
+
     bool is_empty() const noexcept {
         auto produce_pos = _produce_pos.load(std::memory_order_acquire);
         auto consume_pos = _consume_pos.load(std::memory_order_acquire);
@@ -161,16 +227,19 @@ private:
 
     alignas(align) std::atomic<size_t> _produce_pos = 0;
     mutable size_t _consume_pos_cache = 0;
+    wait_strategy _not_empty;
 
     alignas(align) std::atomic<size_t> _consume_pos = 0;
     mutable size_t _produce_pos_cache = 0;
+    wait_strategy _not_full;
 };
 
 template<
     int _buffer_size_log2,
     int _content_align_log2 = ctu::log2_v<sizeof(void*)>,
     typename _difference_type = ptrdiff_t,
-    int _align_log2 = 7
+    int _align_log2 = 7,
+    typename _wait_strategy = busy_spin_wait
 >
 struct alignas(((size_t)1) << _align_log2) spsc_ring_buffer_cached_masked {
     using difference_type = _difference_type;
@@ -178,6 +247,7 @@ struct alignas(((size_t)1) << _align_log2) spsc_ring_buffer_cached_masked {
     static const auto mask = ctu::bit_mask_v<size_t, _buffer_size_log2>;
     static const auto align = size_t(1) << _align_log2;
     static const auto content_align_log2 = _content_align_log2;
+    using wait_strategy = _wait_strategy;
 
     static_assert(std::is_signed_v<difference_type>);
     static_assert(content_align_log2 >= ctu::log2(sizeof(difference_type)));
@@ -218,12 +288,20 @@ struct alignas(((size_t)1) << _align_log2) spsc_ring_buffer_cached_masked {
         new (_buffer + (produce_pos & mask)) difference_type(difference_type(length));
         if (callback(static_cast<void*>(_buffer + (produce_pos & mask) + sizeof(difference_type)))) {
             _produce_pos.store(produce_pos + rounded_length, std::memory_order_release);
+            _not_empty.notify();
             return true;
         }
 
         return false;
     }
 
+    // blocks until the record was produced, see wait_strategy.hpp
+    // callback must not fail
+    template<typename cbtype>
+    void produce_wait(size_t length, cbtype callback) noexcept(noexcept(callback(static_cast<void*>(nullptr)))) {
+        _not_full.wait([&] { return this->produce(length, callback); });
+    }
+
     template<typename cbtype>
     bool consume(cbtype callback) noexcept(noexcept(callback(static_cast<const void*>(nullptr), difference_type(0)))) {
         auto produce_pos = _produce_pos_cache;
@@ -246,12 +324,19 @@ struct alignas(((size_t)1) << _align_log2) spsc_ring_buffer_cached_masked {
         if (callback(static_cast<const void*>(_buffer + (consume_pos & mask) + sizeof(difference_type)), length)) {
             auto rounded_length = ctu::round_up_bits(length + sizeof(difference_type), content_align_log2);
             _consume_pos.store(consume_pos + rounded_length, std::memory_order_release);
+            _not_full.notify();
             return true;
         }
 
         return false;
     }
 
+    // blocks until a record was consumed, callback must accept it
+    template<typename cbtype>
+    void consume_wait(cbtype callback) noexcept(noexcept(callback(static_cast<const void*>(nullptr), difference_type(0)))) {
+        _not_empty.wait([&] { return this->consume(callback); });
+    }
+
     // returns true if buffer is empty after this call
     template<typename cbtype>
     bool consume_all(cbtype callback) noexcept(noexcept(callback(static_cast<const void*>(nullptr), difference_type(0)))) {
@@ -263,6 +348,7 @@ struct alignas(((size_t)1) << _align_log2) spsc_ring_buffer_cached_masked {
 
         scope_guard g([this, &consume_pos]() {
             _consume_pos.store(consume_pos, std::memory_order_release);
+            _not_full.notify();
             });
 
         while (consume_pos != produce_pos) {
@@ -289,6 +375,49 @@ struct alignas(((size_t)1) << _align_log2) spsc_ring_buffer_cached_masked {
         return (consume_pos == produce_pos);
     }
 
+    // Consumes the records available when it is called, up to the first one
+    // callback rejects. _consume_pos is published every publish_interval
+    // records, so the producer can reuse space while the drain goes on, and
+    // once at the end. 0 publishes only at the end.
+    template<typename cbtype>
+    drain_result drain(cbtype callback, size_t publish_interval = 64) noexcept(noexcept(callback(static_cast<const void*>(nullptr), difference_type(0)))) {
+        drain_result result;
+        auto consume_pos = _consume_pos.load(std::memory_order_relaxed);
+        auto produce_pos = _produce_pos.load(std::memory_order_acquire);
+        _produce_pos_cache = produce_pos;
+
+        size_t unpublished = 0;
+        while (consume_pos != produce_pos) {
+            difference_type length;
+            memcpy(&length, _buffer + (consume_pos & mask), sizeof(length));
+
+            if (length < 0) {
+                consume_pos += -length;
+                memcpy(&length, _buffer + (consume_pos & mask), sizeof(length));
+            }
+
+            if (callback(static_cast<const void*>(_buffer + (consume_pos & mask) + sizeof(difference_type)), length) == false)
+                break;
+
+            auto rounded_length = ctu::round_up_bits(length + sizeof(difference_type), content_align_log2);
+            consume_pos += rounded_length;
+            result.records += 1;
+            result.bytes += size_t(length);
+
+            if (++unpublished == publish_interval) {
+                _consume_pos.store(consume_pos, std::memory_order_release);
+                _not_full.notify();
+                unpublished = 0;
+            }
+        }
+
+        if (unpublished > 0) {
+            _consume_pos.store(consume_pos, std::memory_order_release);
+            _not_full.notify();
+        }
+        return result;
+    }
+
     bool is_empty() const noexcept {
         auto produce_pos = _produce_pos.load(std::memory_order_acquire);
         auto consume_pos = _consume_pos.load(std::memory_order_acquire);
@@ -301,7 +430,9 @@ private:
 
     alignas(align) std::atomic<size_t> _produce_pos = 0;
     mutable size_t _consume_pos_cache = 0;
+    wait_strategy _not_empty;
 
     alignas(align) std::atomic<size_t> _consume_pos = 0;
     mutable size_t _produce_pos_cache = 0;
+    wait_strategy _not_full;
 };
@@ -7,6 +7,7 @@
 #include <limits>
 #include "aligned_alloc.hpp"
 #include "compile_time_utilities.hpp"
+#include "drain_result.hpp"
 #include "scope_guard.hpp"
 
 template<
@@ -188,45 +189,79 @@ struct alignas(((size_t)1) << _align_log2) spsc_ring_buffer_chunked {
     // returns true if buffer is empty after this call
     template<typename cbtype>
     bool consume_all(cbtype callback) noexcept(noexcept(callback(static_cast<const void*>(nullptr), difference_type(0)))) {
-        //auto consume_pos = _consume_pos.load(std::memory_order_relaxed);
-        //auto produce_pos = _produce_pos.load(std::memory_order_acquire);
+        bool stopped = false;
+        while (drain_chunks(callback, 0, stopped).records > 0) {
+            if (stopped)
+                return false;
+        }
+        return stopped == false;
+    }
+
+    // Consumes the records available when it is called, up to the first one
+    // callback rejects, moving on to the following chunks the producer has
+    // already filled. A chunk's _consume_pos is published every
+    // publish_interval records and when the drain leaves it. 0 publishes only
+    // when leaving the chunk.
+    template<typename cbtype>
+    drain_result drain(cbtype callback, size_t publish_interval = 64) noexcept(noexcept(callback(static_cast<const void*>(nullptr), difference_type(0)))) {
+        bool stopped = false;
+        return drain_chunks(callback, publish_interval, stopped);
+    }
+
+    bool is_empty() const noexcept {
+        return _head.load(std::memory_order_acquire)->is_empty();
+    }
 
-        //if (produce_pos == consume_pos)
-        //    return true;
+private:
+    template<typename cbtype>
+    drain_result drain_chunks(cbtype& callback, size_t publish_interval, bool& stopped) noexcept(noexcept(callback(static_cast<const void*>(nullptr), difference_type(0)))) {
+        drain_result result;
+        auto tail = _tail.load(std::memory_order_relaxed);
+        // the producer has left every chunk before head, so their produce_pos is final
+        auto head = _head.load(std::memory_order_acquire);
+
+        while (true) {
+            auto consume_pos = tail->_consume_pos.load(std::memory_order_relaxed);
+            auto produce_pos = tail->_produce_pos_cache = tail->_produce_pos.load(std::memory_order_acquire);
 
-        //scope_guard g([this, &consume_pos]() {
-        //    _consume_pos.store(consume_pos, std::memory_order_release);
-        //});
+            size_t unpublished = 0;
+            while (consume_pos != produce_pos) {
+                difference_type length;
+                memcpy(&length, tail->_buffer + consume_pos, sizeof(length));
 
-        //while (consume_pos != produce_pos) {
-        //    while (consume_pos != produce_pos) {
-        //        difference_type length;
-        //        memcpy(&length, _buffer + consume_pos, sizeof(length));
+                if (length < 0) {
+                    consume_pos = 0;
+                    memcpy(&length, tail->_buffer, sizeof(length));
+                }
 
-        //        if (length < 0) {
-        //            consume_pos = 0;
-        //            memcpy(&length, _buffer + consume_pos, sizeof(length));
-        //        }
+                if (callback(static_cast<const void*>(tail->_buffer + consume_pos + sizeof(difference_type)), length) == false) {
+                    stopped = true;
+                    break;
+                }
 
-        //        if (callback(static_cast<const void*>(_buffer + consume_pos + sizeof(difference_type)), length) == false) {
-        //            return false;
-        //        }
+                auto rounded_length = ctu::round_up_bits(length + sizeof(difference_type), content_align_log2);
+                consume_pos = (consume_pos + rounded_length) & chunk_mask;
+                result.records += 1;
+                result.bytes += size_t(length);
 
-        //        auto rounded_length = ctu::round_up_bits(length + sizeof(difference_type), content_align_log2);
-        //        consume_pos = (consume_pos + rounded_length) & chunk_mask;
-        //    }
+                if (++unpublished == publish_interval) {
+                    tail->_consume_pos.store(consume_pos, std::memory_order_release);
+                    unpublished = 0;
+                }
+            }
 
-        //    produce_pos = _produce_pos.load(std::memory_order_acquire);
-        //}
+            if (unpublished > 0) {
+                tail->_consume_pos.store(consume_pos, std::memory_order_release);
+            }
 
-        return true;
-    }
+            if (stopped || tail == head)
+                return result;
 
-    bool is_empty() const noexcept {
-        return _head.load(std::memory_order_acquire)->is_empty();
+            tail = tail->_next;
+            _tail.store(tail, std::memory_order_release);
+        }
     }
 
-private:
     alignas(align) std::array<chunk, chunk_count> _chunks{};
     alignas(align) std::atomic<chunk*> _head = nullptr;
     alignas(align) std::atomic<chunk*> _tail = nullptr;
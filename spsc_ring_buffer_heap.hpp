@@ -6,18 +6,22 @@
 #include <array>
 #include <limits>
 #include <memory>
+#include <new>
 #include "aligned_alloc.hpp"
 #include "compile_time_utilities.hpp"
+#include "drain_result.hpp"
 #include "scope_guard.hpp"
 
 template<
     int _buffer_size_log2,
     int _content_align_log2 = ctu::log2_v<sizeof(void*)>,
     typename _difference_type = ptrdiff_t,
-    int _align_log2 = 7
+    int _align_log2 = 7,
+    typename _allocator = aligned_allocator
 >
 struct alignas(((size_t)1) << _align_log2) spsc_ring_buffer_heap {
     using difference_type = _difference_type;
+    using allocator = _allocator;
     static const auto size = size_t(1) << _buffer_size_log2;
     static const auto mask = ctu::bit_mask_v<size_t, _buffer_size_log2>;
     static const auto align = size_t(1) << _align_log2;
@@ -27,10 +31,10 @@ struct alignas(((size_t)1) << _align_log2) spsc_ring_buffer_heap {
     static_assert(content_align_log2 >= ctu::log2(sizeof(difference_type)));
 
     spsc_ring_buffer_heap() :
-        _buffer(static_cast<std::byte*>(aligned_alloc(align, size))) {}
+        _buffer(allocate_buffer()) {}
 
     spsc_ring_buffer_heap(const spsc_ring_buffer_heap& other) :
-        _buffer(static_cast<std::byte*>(aligned_alloc(align, size))),
+        _buffer(allocate_buffer()),
         _produce_pos(other._produce_pos.load(std::memory_order_acquire)),
         _consume_pos_cache(other._consume_pos_cache),
         _consume_pos(other._consume_pos.load(std::memory_order_acquire)),
@@ -173,6 +177,46 @@ struct alignas(((size_t)1) << _align_log2) spsc_ring_buffer_heap {
         return (consume_pos == produce_pos);
     }
 
+    // Consumes the records available when it is called, up to the first one
+    // callback rejects. _consume_pos is published every publish_interval
+    // records, so the producer can reuse space while the drain goes on, and
+    // once at the end. 0 publishes only at the end.
+    template<typename cbtype>
+    drain_result drain(cbtype callback, size_t publish_interval = 64) noexcept(noexcept(callback(static_cast<const void*>(nullptr), difference_type(0)))) {
+        drain_result result;
+        auto consume_pos = _consume_pos.load(std::memory_order_relaxed);
+        auto produce_pos = _produce_pos.load(std::memory_order_acquire);
+
+        size_t unpublished = 0;
+        while (consume_pos != produce_pos) {
+            difference_type length;
+            memcpy(&length, _buffer.get() + (consume_pos & mask), sizeof(length));
+
+            if (length < 0) {
+                consume_pos += -length;
+                memcpy(&length, _buffer.get() + (consume_pos & mask), sizeof(length));
+            }
+
+            if (callback(static_cast<const void*>(_buffer.get() + (consume_pos & mask) + sizeof(difference_type)), length) == false)
+                break;
+
+            auto rounded_length = ctu::round_up_bits(length + sizeof(difference_type), content_align_log2);
+            consume_pos += rounded_length;
+            result.records += 1;
+            result.bytes += size_t(length);
+
+            if (++unpublished == publish_interval) {
+                _consume_pos.store(consume_pos, std::memory_order_release);
+                unpublished = 0;
+            }
+        }
+
+        if (unpublished > 0) {
+            _consume_pos.store(consume_pos, std::memory_order_release);
+        }
+        return result;
+    }
+
     bool is_empty() const noexcept {
         auto produce_pos = _produce_pos.load(std::memory_order_acquire);
         auto consume_pos = _consume_pos.load(std::memory_order_acquire);
@@ -181,7 +225,20 @@ struct alignas(((size_t)1) << _align_log2) spsc_ring_buffer_heap {
     }
 
 private:
-    alignas(align) std::unique_ptr<std::byte, aligned_free_deleter> _buffer;
+    struct buffer_deleter {
+        void operator()(std::byte* ptr) const noexcept {
+            allocator::deallocate(ptr, size);
+        }
+    };
+
+    static std::byte* allocate_buffer() {
+        auto ptr = static_cast<std::byte*>(allocator::allocate(align, size));
+        if (ptr == nullptr)
+            throw std::bad_alloc();
+        return ptr;
+    }
+
+    alignas(align) std::unique_ptr<std::byte, buffer_deleter> _buffer;
 
     alignas(align) std::atomic<size_t> _produce_pos = 0;
     mutable size_t _consume_pos_cache = 0;
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <limits>
+#include <new>
+#include "compile_time_utilities.hpp"
+
+// Ring buffer that overwrites the oldest records instead of failing when it is
+// full, so the producer never waits for the consumer. Positions grow
+// monotonically like in spsc_ring_buffer_masked.
+//
+// Every record starts with a sequence number and its length. Before writing,
+// the producer announces the end of the area it is about to overwrite in
+// _write_pos, like the odd counter of a seqlock. The consumer reads a record
+// optimistically and afterwards checks that _write_pos has not moved into it.
+// If the consumer was lapped, it resynchronizes to the newest complete record
+// and adds the records it missed to dropped().
+//
+// The consume callback may be handed a record that is overwritten while it
+// runs. It should only copy the record, consume returns false and the copy
+// has to be discarded if that happened.
+template<
+    int _buffer_size_log2,
+    int _content_align_log2 = ctu::log2_v<sizeof(void*)>,
+    typename _difference_type = ptrdiff_t,
+    int _align_log2 = 7
+>
+struct alignas(((size_t) 1) << _align_log2) spsc_ring_buffer_lossy {
+    using difference_type = _difference_type;
+    static const auto size = size_t(1) << _buffer_size_log2;
+    static const auto mask = ctu::bit_mask_v<size_t, _buffer_size_log2>;
+    static const auto align = size_t(1) << _align_log2;
+    static const auto content_align_log2 = _content_align_log2;
+
+    struct record_header {
+        uint64_t sequence;
+        // negative for a wrap marker, which skips to the start of the buffer
+        difference_type length;
+    };
+
+    static_assert(std::is_signed_v<difference_type>);
+    static_assert((size_t(1) << content_align_log2) >= alignof(record_header));
+
+    // Always succeeds for 0 < length < size / 4 - sizeof(record_header),
+    // unless callback returns false, in which case the record is abandoned.
+    template<typename cbtype>
+    bool produce(size_t length, cbtype callback) noexcept(noexcept(callback(static_cast<void*>(nullptr)))) {
+        // the newest record, a wrap marker and the record being written all
+        // fit into the buffer, so the consumer can always resynchronize
+        if (length <= 0 || length >= size / 4 - sizeof(record_header))
+            return false;
+
+        auto rounded_length = ctu::round_up_bits(length + sizeof(record_header), content_align_log2);
+        auto produce_pos = _produce_pos.load(std::memory_order_relaxed);
+
+        auto wrap_distance = size - (produce_pos & mask);
+        auto record_pos = wrap_distance < rounded_length ? produce_pos + wrap_distance : produce_pos;
+
+        _write_pos.store(record_pos + rounded_length, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        if (record_pos != produce_pos) {
+            new (_buffer + (produce_pos & mask)) record_header{ _sequence, -difference_type(wrap_distance) };
+        }
+
+        new (_buffer + (record_pos & mask)) record_header{ _sequence, difference_type(length) };
+        if (callback(static_cast<void*>(_buffer + (record_pos & mask) + sizeof(record_header)))) {
+            _sequence += 1;
+            _latest_pos.store(record_pos, std::memory_order_release);
+            _produce_pos.store(record_pos + rounded_length, std::memory_order_release);
+            return true;
+        }
+
+        return false;
+    }
+
+    template<typename cbtype>
+    bool consume(cbtype callback) noexcept(noexcept(callback(static_cast<const void*>(nullptr), difference_type(0)))) {
+        auto consume_pos = _consume_pos.load(std::memory_order_relaxed);
+        auto produce_pos = _produce_pos.load(std::memory_order_acquire);
+
+        if (produce_pos == consume_pos)
+            return false;
+
+        record_header header;
+        if (read_header(consume_pos, header) == false || header.sequence != _next_sequence) {
+            resync();
+            return false;
+        }
+
+        if (header.length < 0) {
+            consume_pos += -header.length;
+            if (read_header(consume_pos, header) == false || header.sequence != _next_sequence) {
+                resync();
+                return false;
+            }
+        }
+
+        callback(static_cast<const void*>(_buffer + (consume_pos & mask) + sizeof(record_header)), header.length);
+        if (is_intact(consume_pos) == false) {
+            resync();
+            return false;
+        }
+
+        auto rounded_length = ctu::round_up_bits(header.length + sizeof(record_header), content_align_log2);
+        _next_sequence += 1;
+        _consume_pos.store(consume_pos + rounded_length, std::memory_order_release);
+        return true;
+    }
+
+    // records the consumer skipped because the producer overwrote them
+    uint64_t dropped() const noexcept {
+        return _dropped;
+    }
+
+    bool is_empty() const noexcept {
+        auto produce_pos = _produce_pos.load(std::memory_order_acquire);
+        auto consume_pos = _consume_pos.load(std::memory_order_acquire);
+
+        return produce_pos == consume_pos;
+    }
+
+private:
+    // true if nothing from consume_pos onwards was overwritten yet
+    bool is_intact(size_t consume_pos) const noexcept {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return _write_pos.load(std::memory_order_relaxed) - consume_pos <= size;
+    }
+
+    bool read_header(size_t consume_pos, record_header& header) const noexcept {
+        memcpy(&header, _buffer + (consume_pos & mask), sizeof(header));
+        return is_intact(consume_pos);
+    }
+
+    // Continues with the newest complete record. If that is overwritten as
+    // well, the next consume resynchronizes again.
+    void resync() noexcept {
+        auto latest_pos = _latest_pos.load(std::memory_order_acquire);
+
+        record_header header;
+        if (read_header(latest_pos, header) == false)
+            return;
+
+        _dropped += header.sequence - _next_sequence;
+        _next_sequence = header.sequence;
+        _consume_pos.store(latest_pos, std::memory_order_relaxed);
+    }
+
+    alignas(align) std::byte _buffer[size]{};
+
+    alignas(align) std::atomic<size_t> _write_pos = 0;
+    std::atomic<size_t> _produce_pos = 0;
+    std::atomic<size_t> _latest_pos = 0;
+    uint64_t _sequence = 0;
+
+    alignas(align) std::atomic<size_t> _consume_pos = 0;
+    uint64_t _next_sequence = 0;
+    uint64_t _dropped = 0;
+};
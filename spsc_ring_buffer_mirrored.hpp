@@ -0,0 +1,185 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+#include <limits>
+#include <new>
+#include "compile_time_utilities.hpp"
+#include "scope_guard.hpp"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Like spsc_ring_buffer_heap, but the buffer is mapped twice, back to back, so
+// that every record is contiguous in memory even if it crosses the end of the
+// buffer. This removes the wrap markers and the space wasted in front of them.
+//
+// The mapping uses memfd_create and is only available on Linux, on other
+// platforms the constructor throws std::bad_alloc. The buffer size has to be a
+// multiple of the page size.
+template<
+    int _buffer_size_log2,
+    int _content_align_log2 = ctu::log2_v<sizeof(void*)>,
+    typename _difference_type = ptrdiff_t,
+    int _align_log2 = 7
+>
+struct alignas(((size_t)1) << _align_log2) spsc_ring_buffer_mirrored {
+    using difference_type = _difference_type;
+    static const auto size = size_t(1) << _buffer_size_log2;
+    static const auto mask = ctu::bit_mask_v<size_t, _buffer_size_log2>;
+    static const auto align = size_t(1) << _align_log2;
+    static const auto content_align_log2 = _content_align_log2;
+
+    static_assert(std::is_signed_v<difference_type>);
+    static_assert(content_align_log2 >= ctu::log2(sizeof(difference_type)));
+    static_assert(_buffer_size_log2 >= 12, "Buffer must span at least one page");
+
+    spsc_ring_buffer_mirrored() :
+        _buffer(map_buffer()) {}
+
+    spsc_ring_buffer_mirrored(const spsc_ring_buffer_mirrored&) = delete;
+    spsc_ring_buffer_mirrored& operator=(const spsc_ring_buffer_mirrored&) = delete;
+
+    ~spsc_ring_buffer_mirrored() {
+#if defined(__linux__)
+        munmap(_buffer, 2 * size);
+#endif
+    }
+
+    template<typename cbtype>
+    bool produce(size_t length, cbtype callback) noexcept(noexcept(callback(static_cast<void*>(nullptr)))) {
+        if (length <= 0 || length >= size)
+            return false;
+
+        auto rounded_length = ctu::round_up_bits(length + sizeof(difference_type), content_align_log2);
+
+        if constexpr (size >= size_t(std::numeric_limits<difference_type>::max())) {
+            if (rounded_length > size_t(std::numeric_limits<difference_type>::max()))
+                return false;
+        }
+
+        auto consume_pos = _consume_pos_cache;
+        auto produce_pos = _produce_pos.load(std::memory_order_relaxed);
+
+        if ((produce_pos - consume_pos) > (size - rounded_length)) {
+            consume_pos = _consume_pos_cache = _consume_pos.load(std::memory_order_acquire);
+            if ((produce_pos - consume_pos) > (size - rounded_length))
+                return false;
+        }
+
+        new (_buffer + (produce_pos & mask)) difference_type(difference_type(length));
+        if (callback(static_cast<void*>(_buffer + (produce_pos & mask) + sizeof(difference_type)))) {
+            _produce_pos.store(produce_pos + rounded_length, std::memory_order_release);
+            return true;
+        }
+
+        return false;
+    }
+
+    template<typename cbtype>
+    bool consume(cbtype callback) noexcept(noexcept(callback(static_cast<const void*>(nullptr), difference_type(0)))) {
+        auto consume_pos = _consume_pos.load(std::memory_order_relaxed);
+        auto produce_pos = _produce_pos_cache;
+
+        if (produce_pos == consume_pos) {
+            produce_pos = _produce_pos_cache = _produce_pos.load(std::memory_order_acquire);
+            if (produce_pos == consume_pos)
+                return false;
+        }
+
+        difference_type length;
+        memcpy(&length, _buffer + (consume_pos & mask), sizeof(length));
+
+        if (callback(static_cast<const void*>(_buffer + (consume_pos & mask) + sizeof(difference_type)), length)) {
+            auto rounded_length = ctu::round_up_bits(length + sizeof(difference_type), content_align_log2);
+            _consume_pos.store(consume_pos + rounded_length, std::memory_order_release);
+            return true;
+        }
+
+        return false;
+    }
+
+    // returns true if buffer is empty after this call
+    template<typename cbtype>
+    bool consume_all(cbtype callback) noexcept(noexcept(callback(static_cast<const void*>(nullptr), difference_type(0)))) {
+        auto consume_pos = _consume_pos.load(std::memory_order_relaxed);
+        auto produce_pos = _produce_pos.load(std::memory_order_acquire);
+
+        if (produce_pos == consume_pos)
+            return true;
+
+        scope_guard g([this, &consume_pos]() {
+            _consume_pos.store(consume_pos, std::memory_order_release);
+        });
+
+        while (consume_pos != produce_pos) {
+            while (consume_pos != produce_pos) {
+                difference_type length;
+                memcpy(&length, _buffer + (consume_pos & mask), sizeof(length));
+
+                if (callback(static_cast<const void*>(_buffer + (consume_pos & mask) + sizeof(difference_type)), length) == false) {
+                    return false;
+                }
+
+                auto rounded_length = ctu::round_up_bits(length + sizeof(difference_type), content_align_log2);
+                consume_pos += rounded_length;
+            }
+
+            produce_pos = _produce_pos.load(std::memory_order_acquire);
+        }
+
+        return (consume_pos == produce_pos);
+    }
+
+    bool is_empty() const noexcept {
+        auto produce_pos = _produce_pos.load(std::memory_order_acquire);
+        auto consume_pos = _consume_pos.load(std::memory_order_acquire);
+
+        return produce_pos == consume_pos;
+    }
+
+private:
+    // Reserves twice the size of address space, then maps the same memory
+    // file into both halves.
+    static std::byte* map_buffer() {
+#if defined(__linux__)
+        int fd = memfd_create("spsc_ring_buffer_mirrored", MFD_CLOEXEC);
+        if (fd < 0)
+            throw std::bad_alloc();
+
+        scope_guard close_fd([fd]() {
+            close(fd);
+        });
+
+        if (ftruncate(fd, off_t(size)) != 0)
+            throw std::bad_alloc();
+
+        void* reserved = mmap(nullptr, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (reserved == MAP_FAILED)
+            throw std::bad_alloc();
+
+        auto buffer = static_cast<std::byte*>(reserved);
+        const int prot = PROT_READ | PROT_WRITE;
+        if (mmap(buffer, size, prot, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED
+            || mmap(buffer + size, size, prot, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+            munmap(reserved, 2 * size);
+            throw std::bad_alloc();
+        }
+
+        return buffer;
+#else
+        throw std::bad_alloc();
+#endif
+    }
+
+    std::byte* const _buffer;
+
+    alignas(align) std::atomic<size_t> _produce_pos = 0;
+    mutable size_t _consume_pos_cache = 0;
+
+    alignas(align) std::atomic<size_t> _consume_pos = 0;
+    mutable size_t _produce_pos_cache = 0;
+};
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <type_traits>
+#include "compile_time_utilities.hpp"
+#include "scope_guard.hpp"
+#include "shared_memory.hpp"
+
+// spsc_ring_buffer_heap for two processes, see spsc_queue_shm for how create
+// and attach work. The buffer directly follows the ring buffer in memory, its
+// size is set at runtime and must be a power of two.
+template<
+    int _content_align_log2 = ctu::log2_v<sizeof(void*)>,
+    typename _difference_type = ptrdiff_t,
+    int _align_log2 = 7
+>
+struct alignas(((size_t)1) << _align_log2) spsc_ring_buffer_shm {
+    using difference_type = _difference_type;
+    static const auto align = size_t(1) << _align_log2;
+    static const auto content_align_log2 = _content_align_log2;
+    static const uint64_t magic = shm_magic("SPSCRING");
+    static const uint32_t version = 1;
+    // checked by attach, both processes have to agree on the record format
+    static const uint32_t layout = uint32_t(sizeof(difference_type) << 8) | uint32_t(content_align_log2);
+
+    static_assert(std::is_signed_v<difference_type>);
+    static_assert(content_align_log2 >= ctu::log2(sizeof(difference_type)));
+
+    // bytes of memory a ring buffer with the given buffer size occupies
+    static size_t required_size(size_t size) noexcept {
+        return sizeof(spsc_ring_buffer_shm) + size;
+    }
+
+    // Constructs a ring buffer at memory, which has to be aligned to align.
+    // Returns nullptr if size is not a power of two or memory is too small.
+    static spsc_ring_buffer_shm* create(void* memory, size_t memory_size, size_t size) noexcept {
+        if (size < (size_t(1) << content_align_log2) || (size & (size - 1)) != 0)
+            return nullptr;
+        if (memory_size < required_size(size) || (reinterpret_cast<uintptr_t>(memory) & (align - 1)) != 0)
+            return nullptr;
+
+        return new(memory) spsc_ring_buffer_shm(size);
+    }
+
+    // Returns the ring buffer constructed at memory by create, possibly in
+    // another process, or nullptr if there is none or it was built with
+    // different parameters.
+    static spsc_ring_buffer_shm* attach(void* memory, size_t memory_size) noexcept {
+        if (memory_size < sizeof(spsc_ring_buffer_shm) || (reinterpret_cast<uintptr_t>(memory) & (align - 1)) != 0)
+            return nullptr;
+
+        auto buffer = std::launder(static_cast<spsc_ring_buffer_shm*>(memory));
+        const shm_header& header = buffer->_header;
+        if (header.magic.load(std::memory_order_acquire) != magic)
+            return nullptr;
+        if (header.version != version || header.layout != layout)
+            return nullptr;
+        if (memory_size < required_size(header.capacity))
+            return nullptr;
+
+        return buffer;
+    }
+
+    spsc_ring_buffer_shm(const spsc_ring_buffer_shm&) = delete;
+    spsc_ring_buffer_shm& operator=(const spsc_ring_buffer_shm&) = delete;
+
+    size_t size() const noexcept {
+        return _mask + 1;
+    }
+
+    template<typename cbtype>
+    bool produce(size_t length, cbtype callback) noexcept(noexcept(callback(static_cast<void*>(nullptr)))) {
+        const auto size = _mask + 1;
+        if (length <= 0 || length >= size)
+            return false;
+
+        auto rounded_length = ctu::round_up_bits(length + sizeof(difference_type), content_align_log2);
+
+        if (rounded_length > size_t(std::numeric_limits<difference_type>::max()))
+            return false;
+
+        auto consume_pos = _consume_pos_cache;
+        auto produce_pos = _produce_pos.load(std::memory_order_relaxed);
+
+        if ((produce_pos - consume_pos) > (size - rounded_length)) {
+            consume_pos = _consume_pos_cache = _consume_pos.load(std::memory_order_acquire);
+            if ((produce_pos - consume_pos) > (size - rounded_length))
+                return false;
+        }
+
+        auto wrap_distance = size - (produce_pos & _mask);
+        if (wrap_distance < rounded_length) {
+            if ((produce_pos + wrap_distance - consume_pos) > (size - rounded_length)) {
+                consume_pos = _consume_pos_cache = _consume_pos.load(std::memory_order_acquire);
+                if ((produce_pos + wrap_distance - consume_pos) > (size - rounded_length))
+                    return false;
+            }
+
+            new (buffer() + (produce_pos & _mask)) difference_type(-difference_type(wrap_distance));
+            produce_pos += wrap_distance;
+        }
+
+        new (buffer() + (produce_pos & _mask)) difference_type(difference_type(length));
+        if (callback(static_cast<void*>(buffer() + (produce_pos & _mask) + sizeof(difference_type)))) {
+            _produce_pos.store(produce_pos + rounded_length, std::memory_order_release);
+            return true;
+        }
+
+        return false;
+    }
+
+    template<typename cbtype>
+    bool consume(cbtype callback) noexcept(noexcept(callback(static_cast<const void*>(nullptr), difference_type(0)))) {
+        auto consume_pos = _consume_pos.load(std::memory_order_relaxed);
+        auto produce_pos = _produce_pos_cache;
+
+        if (produce_pos == consume_pos) {
+            produce_pos = _produce_pos_cache = _produce_pos.load(std::memory_order_acquire);
+            if (produce_pos == consume_pos)
+                return false;
+        }
+
+        difference_type length;
+        memcpy(&length, buffer() + (consume_pos & _mask), sizeof(length));
+
+        if (length < 0) {
+            consume_pos += -length;
+            memcpy(&length, buffer() + (consume_pos & _mask), sizeof(length));
+        }
+
+        if (callback(static_cast<const void*>(buffer() + (consume_pos & _mask) + sizeof(difference_type)), length)) {
+            auto rounded_length = ctu::round_up_bits(length + sizeof(difference_type), content_align_log2);
+            _consume_pos.store(consume_pos + rounded_length, std::memory_order_release);
+            return true;
+        }
+
+        return false;
+    }
+
+    // returns true if buffer is empty after this call
+    template<typename cbtype>
+    bool consume_all(cbtype callback) noexcept(noexcept(callback(static_cast<const void*>(nullptr), difference_type(0)))) {
+        auto consume_pos = _consume_pos.load(std::memory_order_relaxed);
+        auto produce_pos = _produce_pos.load(std::memory_order_acquire);
+
+        if (produce_pos == consume_pos)
+            return true;
+
+        scope_guard g([this, &consume_pos]() {
+            _consume_pos.store(consume_pos, std::memory_order_release);
+        });
+
+        while (consume_pos != produce_pos) {
+            while (consume_pos != produce_pos) {
+                difference_type length;
+                memcpy(&length, buffer() + (consume_pos & _mask), sizeof(length));
+
+                if (length < 0) {
+                    consume_pos += -length;
+                    memcpy(&length, buffer() + (consume_pos & _mask), sizeof(length));
+                }
+
+                if (callback(static_cast<const void*>(buffer() + (consume_pos & _mask) + sizeof(difference_type)), length) == false) {
+                    return false;
+                }
+
+                auto rounded_length = ctu::round_up_bits(length + sizeof(difference_type), content_align_log2);
+                consume_pos += rounded_length;
+            }
+
+            produce_pos = _produce_pos.load(std::memory_order_acquire);
+        }
+
+        return (consume_pos == produce_pos);
+    }
+
+    bool is_empty() const noexcept {
+        auto produce_pos = _produce_pos.load(std::memory_order_acquire);
+        auto consume_pos = _consume_pos.load(std::memory_order_acquire);
+
+        return produce_pos == consume_pos;
+    }
+
+private:
+    explicit spsc_ring_buffer_shm(size_t size) noexcept :
+        _mask(size - 1)
+    {
+        _header.version = version;
+        _header.layout = layout;
+        _header.capacity = size;
+        _header.magic.store(magic, std::memory_order_release);
+    }
+
+    // the buffer directly follows the ring buffer
+    std::byte* buffer() noexcept {
+        return reinterpret_cast<std::byte*>(this) + sizeof(spsc_ring_buffer_shm);
+    }
+
+    shm_header _header;
+    const size_t _mask;
+
+    alignas(align) std::atomic<size_t> _produce_pos = 0;
+    mutable size_t _consume_pos_cache = 0;
+
+    alignas(align) std::atomic<size_t> _consume_pos = 0;
+    mutable size_t _produce_pos_cache = 0;
+};
@@ -0,0 +1,552 @@
+#!/usr/bin/env python3
+"""Results database for RingBufferBenchmark.
+
+  run       runs the benchmark binary with JSON output and ingests the result
+  adaptive  like run, but repeats each cell only until its throughput is stable
+  ingest    converts a Google Benchmark JSON file into a results file
+  list      lists the results files in a directory
+  compare   flags significant throughput changes between two results files
+  alignment recommends alignments from a run of AlignmentTest.cpp
+
+A results file holds one run, named <git sha>_<cpu model>_<time>.json.gz. It
+stores one column per field instead of one object per repetition, strings
+are dictionary encoded. Cells (one benchmark instance: queue, element size,
+capacity, core pair) are compared with a two-sided Mann-Whitney U test over
+the items_per_second of their repetitions.
+
+Only the standard library is used.
+"""
+
+import argparse
+import datetime
+import gzip
+import json
+import math
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+FORMAT_VERSION = 1
+DEFAULT_DIRECTORY = "results"
+
+# fields of a benchmark entry that are not counters
+RESERVED_FIELDS = {
+    "name", "run_name", "run_type", "repetitions", "repetition_index", "threads",
+    "iterations", "real_time", "cpu_time", "time_unit", "label", "error_occurred",
+    "error_message", "family_index", "per_family_instance_index", "aggregate_name",
+    "aggregate_unit", "bytes_per_second", "items_per_second",
+}
+
+AGGREGATE_SUFFIXES = ("_mean", "_median", "_stddev", "_cv")
+
+TIME_UNIT_NS = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+
+# QUEUE_BENCH instances, eg. QueuePushPop<spsc_queue_adapter<DummyContainer<8>, (std::size_t(1) << 12) / 8>>
+QUEUE_BENCH_NAME = re.compile(
+    r"^(?P<function>\w+)<(?P<queue>[\w:]+)<DummyContainer<(?P<element_size>\d+)>,\s*"
+    r"\(std::size_t\(1\) << (?P<capacity_log2>\d+)\) / \d+>")
+FUNCTION_NAME = re.compile(r"^(?P<function>\w+)")
+
+# AlignmentTest.cpp, eg. AlignmentPushPop<spsc_queue_alignment_adapter<7>>/pair:0
+# and AlignmentFalseSharing/pair:0/distance:64
+ALIGNMENT_PUSH_POP_NAME = re.compile(r"^AlignmentPushPop<(?P<family>\w+)_alignment_adapter<(?P<align_log2>\d+)>>")
+ALIGNMENT_FALSE_SHARING_NAME = re.compile(r"^AlignmentFalseSharing/.*/distance:(?P<distance>\d+)")
+
+
+def git_sha():
+    try:
+        return subprocess.check_output(
+            ["git", "rev-parse", "HEAD"], stderr=subprocess.DEVNULL, text=True).strip()
+    except (OSError, subprocess.CalledProcessError):
+        return "unknown"
+
+
+def cpu_model():
+    try:
+        with open("/proc/cpuinfo") as f:
+            for line in f:
+                if line.startswith("model name"):
+                    return line.split(":", 1)[1].strip()
+    except OSError:
+        pass
+    return "unknown"
+
+
+def slug(text):
+    return re.sub(r"[^A-Za-z0-9]+", "-", text).strip("-")[:48] or "unknown"
+
+
+# the number of repetitions is part of the instance name, but it must not
+# keep runs with different repetition counts from sharing cells
+REPEATS = re.compile(r"/repeats:\d+")
+
+
+def run_name(entry):
+    return REPEATS.sub("", entry.get("run_name", entry["name"]))
+
+
+def is_aggregate(entry):
+    if "run_type" in entry:
+        return entry["run_type"] == "aggregate"
+    return entry["name"].endswith(AGGREGATE_SUFFIXES)
+
+
+def describe(name):
+    """Splits a benchmark name into function, queue, element size and capacity."""
+    m = QUEUE_BENCH_NAME.match(name)
+    if m:
+        return (m.group("function"), m.group("queue"),
+                int(m.group("element_size")), int(m.group("capacity_log2")))
+    m = FUNCTION_NAME.match(name)
+    return (m.group("function") if m else name, None, None, None)
+
+
+def to_columns(benchmark_json, sha, cpu):
+    rows = []
+    repetitions = {}
+    for entry in benchmark_json.get("benchmarks", []):
+        if is_aggregate(entry):
+            continue
+
+        name = run_name(entry)
+        key = (name, entry.get("label", ""))
+        repetition = entry.get("repetition_index", repetitions.get(key, 0))
+        repetitions[key] = repetition + 1
+
+        function, queue, element_size, capacity_log2 = describe(name)
+        scale = TIME_UNIT_NS.get(entry.get("time_unit", "ns"), 1.0)
+        row = {
+            "benchmark": name,
+            "function": function,
+            "queue": queue,
+            "element_size": element_size,
+            "capacity_log2": capacity_log2,
+            "label": entry.get("label", ""),
+            "repetition": repetition,
+            "threads": entry.get("threads", 1),
+            "iterations": entry.get("iterations"),
+            "real_time_ns": entry.get("real_time", 0.0) * scale,
+            "cpu_time_ns": entry.get("cpu_time", 0.0) * scale,
+            "items_per_second": entry.get("items_per_second"),
+            "bytes_per_second": entry.get("bytes_per_second"),
+            "error": bool(entry.get("error_occurred", False)),
+        }
+        for field, value in entry.items():
+            if field not in RESERVED_FIELDS and isinstance(value, (int, float)):
+                row["counter:" + field] = value
+        rows.append(row)
+
+    names = []
+    for row in rows:
+        for field in row:
+            if field not in names:
+                names.append(field)
+
+    columns = {}
+    dictionaries = {}
+    for field in names:
+        values = [row.get(field) for row in rows]
+        if any(isinstance(v, str) for v in values):
+            dictionary = sorted({v for v in values if v is not None})
+            index = {v: i for i, v in enumerate(dictionary)}
+            dictionaries[field] = dictionary
+            values = [None if v is None else index[v] for v in values]
+        columns[field] = values
+
+    return {
+        "format": FORMAT_VERSION,
+        "sha": sha,
+        "cpu": cpu,
+        "context": benchmark_json.get("context", {}),
+        "rows": len(rows),
+        "dictionaries": dictionaries,
+        "columns": columns,
+    }
+
+
+def write_results(results, directory):
+    os.makedirs(directory, exist_ok=True)
+    stamp = datetime.datetime.now().strftime("%Y%m%dT%H%M%S")
+    base = "%s_%s_%s" % (results["sha"][:12], slug(results["cpu"]), stamp)
+    # runs finishing within the same second get a counter appended
+    attempt = 0
+    while True:
+        path = os.path.join(directory, base + ("-%d" % attempt if attempt else "") + ".json.gz")
+        try:
+            f = gzip.open(path, "xt")
+        except FileExistsError:
+            attempt += 1
+            continue
+        with f:
+            json.dump(results, f, separators=(",", ":"))
+        return path
+
+
+def read_results(path):
+    with gzip.open(path, "rt") as f:
+        results = json.load(f)
+    if results.get("format") != FORMAT_VERSION:
+        raise SystemExit("%s: unsupported format %r" % (path, results.get("format")))
+    return results
+
+
+def column(results, field):
+    values = results["columns"].get(field, [None] * results["rows"])
+    dictionary = results["dictionaries"].get(field)
+    if dictionary is None:
+        return values
+    return [None if v is None else dictionary[v] for v in values]
+
+
+def samples_by_cell(results):
+    cells = {}
+    for name, label, throughput, error in zip(
+            column(results, "benchmark"), column(results, "label"),
+            column(results, "items_per_second"), column(results, "error")):
+        if error or throughput is None:
+            continue
+        cells.setdefault((REPEATS.sub("", name), label or ""), []).append(throughput)
+    return cells
+
+
+def median(values):
+    values = sorted(values)
+    n = len(values)
+    return values[n // 2] if n % 2 else (values[n // 2 - 1] + values[n // 2]) / 2.0
+
+
+def mann_whitney_u(a, b):
+    """Two-sided p-value of the Mann-Whitney U test, normal approximation
+    with tie and continuity correction."""
+    n1, n2 = len(a), len(b)
+    combined = sorted([(v, 0) for v in a] + [(v, 1) for v in b])
+    n = n1 + n2
+
+    rank_sum_a = 0.0
+    tie_term = 0.0
+    i = 0
+    while i < n:
+        j = i
+        while j + 1 < n and combined[j + 1][0] == combined[i][0]:
+            j += 1
+        rank = (i + j) / 2.0 + 1.0
+        ties = j - i + 1
+        tie_term += ties ** 3 - ties
+        for k in range(i, j + 1):
+            if combined[k][1] == 0:
+                rank_sum_a += rank
+        i = j + 1
+
+    u = rank_sum_a - n1 * (n1 + 1) / 2.0
+    mean = n1 * n2 / 2.0
+    variance = n1 * n2 / 12.0 * ((n + 1) - tie_term / (n * (n - 1)))
+    if variance <= 0.0:
+        return 1.0
+    z = (abs(u - mean) - 0.5) / math.sqrt(variance)
+    return math.erfc(max(z, 0.0) / math.sqrt(2.0))
+
+
+def command_ingest(args):
+    with open(args.json) as f:
+        benchmark_json = json.load(f)
+    results = to_columns(benchmark_json, args.sha or git_sha(), args.cpu or cpu_model())
+    print(write_results(results, args.directory))
+
+
+def benchmark_command(args):
+    command = args.command[1:] if args.command[:1] == ["--"] else args.command
+    if not command:
+        raise SystemExit("%s: missing benchmark command" % args.subcommand)
+    return command
+
+
+def run_benchmark(command, extra_args=(), repetitions=None):
+    """Runs the benchmark binary and returns its JSON output. The console
+    output of the binary is left untouched."""
+    env = dict(os.environ)
+    if repetitions is not None:
+        env["RBB_REPETITIONS"] = str(repetitions)
+
+    fd, out = tempfile.mkstemp(suffix=".json")
+    os.close(fd)
+    try:
+        status = subprocess.call(
+            command + list(extra_args) + ["--benchmark_out=" + out, "--benchmark_out_format=json"], env=env)
+        if status != 0:
+            raise SystemExit("%s exited with %d" % (command[0], status))
+        with open(out) as f:
+            text = f.read()
+    finally:
+        os.unlink(out)
+
+    try:
+        benchmark_json = json.loads(text)
+    except ValueError:
+        raise SystemExit("%s wrote no valid JSON output%s" % (
+            command[0], "" if text.strip() else " (empty file)"))
+    if not benchmark_json.get("benchmarks"):
+        raise SystemExit("%s ran no benchmarks, check the filter in %s" % (command[0], " ".join(extra_args) or "its arguments"))
+    return benchmark_json
+
+
+def command_run(args):
+    benchmark_json = run_benchmark(benchmark_command(args))
+    results = to_columns(benchmark_json, args.sha or git_sha(), args.cpu or cpu_model())
+    print(write_results(results, args.directory))
+
+
+def relative_confidence_width(samples, statistic):
+    """Width of the 95% confidence interval of the mean or the median,
+    relative to that statistic. The interval of the median is the
+    distribution-free one between two order statistics."""
+    n = len(samples)
+    if n < 3:
+        return math.inf
+
+    if statistic == "mean":
+        mean = sum(samples) / n
+        variance = sum((x - mean) ** 2 for x in samples) / (n - 1)
+        return 2.0 * 1.96 * math.sqrt(variance / n) / mean if mean > 0 else math.inf
+
+    values = sorted(samples)
+    half = 1.96 * math.sqrt(n) / 2.0
+    lower = max(int(math.floor(n / 2.0 - half)), 0)
+    upper = min(int(math.ceil(n / 2.0 + half)), n - 1)
+    m = median(values)
+    return (values[upper] - values[lower]) / m if m > 0 else math.inf
+
+
+def regex_literal(text):
+    """text as a regular expression that Google Benchmark compiles with
+    either std::regex or POSIX extended regex. Backslash escapes mean
+    different things to them (\\< is a word boundary to GNU regex, \\d is
+    invalid in POSIX), so special characters go into bracket expressions.
+    The few that cannot be bracketed match any character instead."""
+    result = []
+    for c in text:
+        if c in ".[()*+?{}|$":
+            result.append("[%s]" % c)
+        elif c in "^]\\":
+            result.append(".")
+        else:
+            result.append(c)
+    return "".join(result)
+
+
+def cell_filter(names):
+    """--benchmark_filter matching exactly the given run names, whatever the
+    number of repetitions in the instance name."""
+    repeats = "(/repeats:[0-9]+)?"
+
+    def pattern(name):
+        return regex_literal(REPEATS.sub("", name)).replace("/threads:", repeats + "/threads:") + repeats
+    return "^(" + "|".join(pattern(name) for name in names) + ")$"
+
+
+def command_adaptive(args):
+    command = benchmark_command(args)
+    entries = {}
+    context = {}
+
+    def collect(benchmark_json):
+        context.update(benchmark_json.get("context", {}))
+        names = set()
+        for entry in benchmark_json.get("benchmarks", []):
+            if is_aggregate(entry):
+                continue
+            entry = dict(entry)
+            # numbered again across batches by to_columns
+            entry.pop("repetition_index", None)
+            names.add(run_name(entry))
+            entries.setdefault(run_name(entry), []).append(entry)
+        return names
+
+    def samples(name):
+        return [e["items_per_second"] for e in entries[name]
+                if not e.get("error_occurred", False) and e.get("items_per_second") is not None]
+
+    def done(name):
+        values = samples(name)
+        return (not values or len(entries[name]) >= args.max
+                or relative_confidence_width(values, args.statistic) <= args.target)
+
+    collect(run_benchmark(command, repetitions=args.min))
+    pending = [name for name in entries if not done(name)]
+    while pending:
+        print("%d of %d cells above target width, %d more repetitions each" % (
+            len(pending), len(entries), args.batch), file=sys.stderr)
+        for i in range(0, len(pending), args.cells_per_run):
+            batch = pending[i:i + args.cells_per_run]
+            missing = set(batch) - collect(run_benchmark(
+                command, ["--benchmark_filter=" + cell_filter(batch)], repetitions=args.batch))
+            if missing:
+                raise SystemExit("rerun did not match %d cells, eg. %s" % (len(missing), sorted(missing)[0]))
+        pending = [name for name in pending if not done(name)]
+
+    total = 0
+    unconverged = 0
+    for name, cell_entries in entries.items():
+        values = samples(name)
+        width = relative_confidence_width(values, args.statistic) if values else 0.0
+        total += len(cell_entries)
+        if width > args.target:
+            unconverged += 1
+        if args.verbose or width > args.target:
+            print("%4d repetitions  %6.2f%%  %s" % (len(cell_entries), width * 100.0, name), file=sys.stderr)
+    print("%d cells, %d repetitions (%d with a fixed --max), %d above target width" % (
+        len(entries), total, len(entries) * args.max, unconverged), file=sys.stderr)
+
+    merged = {"context": context, "benchmarks": [e for cell_entries in entries.values() for e in cell_entries]}
+    results = to_columns(merged, args.sha or git_sha(), args.cpu or cpu_model())
+    print(write_results(results, args.directory))
+
+
+def command_list(args):
+    if not os.path.isdir(args.directory):
+        return
+    for name in sorted(os.listdir(args.directory)):
+        if not name.endswith(".json.gz"):
+            continue
+        results = read_results(os.path.join(args.directory, name))
+        print("%s  %s  %s  %d rows" % (name, results["sha"][:12], results["cpu"], results["rows"]))
+
+
+def command_compare(args):
+    base = read_results(args.base)
+    new = read_results(args.new)
+    if base["cpu"] != new["cpu"]:
+        print("warning: comparing runs on different CPUs (%s, %s)" % (base["cpu"], new["cpu"]), file=sys.stderr)
+
+    base_cells = samples_by_cell(base)
+    new_cells = samples_by_cell(new)
+    if not base_cells.keys() & new_cells.keys():
+        print("error: %s and %s have no benchmark instance in common" % (args.base, args.new), file=sys.stderr)
+        return 2
+
+    regressions = []
+    improvements = []
+    skipped = 0
+    for cell in sorted(base_cells.keys() & new_cells.keys()):
+        a, b = base_cells[cell], new_cells[cell]
+        if len(a) < args.min_samples or len(b) < args.min_samples:
+            skipped += 1
+            continue
+
+        change = median(b) / median(a) - 1.0
+        p = mann_whitney_u(a, b)
+        if p >= args.alpha or abs(change) < args.threshold:
+            continue
+        (regressions if change < 0 else improvements).append((change, p, cell))
+
+    def show(title, rows):
+        if not rows:
+            return
+        print("%s:" % title)
+        for change, p, (name, label) in sorted(rows):
+            print("  %+7.1f%%  p=%.2g  %s%s" % (change * 100.0, p, name, " [%s]" % label if label else ""))
+
+    show("regressions", regressions)
+    if args.show_improvements:
+        show("improvements", improvements)
+
+    print("%d cells compared, %d regressions, %d improvements, %d with too few samples" % (
+        len(base_cells.keys() & new_cells.keys()) - skipped, len(regressions), len(improvements), skipped))
+    return 1 if regressions else 0
+
+
+def alignment_cell(name):
+    """(family, bytes) of an AlignmentTest.cpp instance, None for others."""
+    m = ALIGNMENT_PUSH_POP_NAME.match(name)
+    if m:
+        return m.group("family"), 1 << int(m.group("align_log2"))
+    m = ALIGNMENT_FALSE_SHARING_NAME.match(name)
+    if m:
+        return "false_sharing", int(m.group("distance"))
+    return None
+
+
+def command_alignment(args):
+    results = read_results(args.results)
+    samples = {}
+    for (name, label), throughput in samples_by_cell(results).items():
+        cell = alignment_cell(name)
+        if cell is not None:
+            family, size = cell
+            samples.setdefault((family, label), {}).setdefault(size, []).extend(throughput)
+    if not samples:
+        print("error: %s has no results of AlignmentTest.cpp" % args.results, file=sys.stderr)
+        return 2
+
+    # the smallest alignment (or distance) within --tolerance of the best
+    # median throughput, and what going one step below it costs
+    print("%-24s %-16s %12s %12s %12s" % ("family", "pair", "best", "recommended", "loss below"))
+    for (family, pair), by_size in sorted(samples.items()):
+        medians = sorted((size, median(values)) for size, values in by_size.items())
+        best_size, best = max(medians, key=lambda m: m[1])
+        index = next(i for i, (_, m) in enumerate(medians) if m >= (1.0 - args.tolerance) * best)
+        loss = 1.0 - medians[index - 1][1] / best if index > 0 and best > 0 else 0.0
+        print("%-24s %-16s %12d %12d %11.1f%%" % (family, pair, best_size, medians[index][0], loss * 100.0))
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest="subcommand", required=True)
+
+    def add_identity(p):
+        p.add_argument("--directory", default=DEFAULT_DIRECTORY, help="where results files are written")
+        p.add_argument("--sha", help="git sha of the run, default: HEAD of the current directory")
+        p.add_argument("--cpu", help="cpu model of the run, default: from /proc/cpuinfo")
+
+    p = commands.add_parser("run", help="run a benchmark binary and ingest its output")
+    add_identity(p)
+    p.add_argument("command", nargs=argparse.REMAINDER, help="benchmark binary and its arguments")
+    p.set_defaults(func=command_run)
+
+    p = commands.add_parser("adaptive", help="run a benchmark binary, repeating each cell until its throughput is stable")
+    add_identity(p)
+    p.add_argument("--statistic", choices=("median", "mean"), default="median",
+                   help="statistic whose confidence interval is checked, default median")
+    p.add_argument("--target", type=float, default=0.02,
+                   help="relative width of the 95%% confidence interval to reach, default 0.02")
+    p.add_argument("--min", type=int, default=10, help="repetitions of every cell, default 10")
+    p.add_argument("--max", type=int, default=200, help="maximum repetitions of a cell, default 200")
+    p.add_argument("--batch", type=int, default=10, help="repetitions added per round, default 10")
+    p.add_argument("--cells-per-run", type=int, default=32, help="cells per benchmark process, default 32")
+    p.add_argument("--verbose", action="store_true", help="list the repetitions of every cell")
+    p.add_argument("command", nargs=argparse.REMAINDER, help="benchmark binary and its arguments")
+    p.set_defaults(func=command_adaptive)
+
+    p = commands.add_parser("ingest", help="ingest Google Benchmark JSON output")
+    add_identity(p)
+    p.add_argument("json", help="output of --benchmark_out_format=json")
+    p.set_defaults(func=command_ingest)
+
+    p = commands.add_parser("list", help="list results files")
+    p.add_argument("--directory", default=DEFAULT_DIRECTORY)
+    p.set_defaults(func=command_list)
+
+    p = commands.add_parser("compare", help="flag significant changes from base to new")
+    p.add_argument("base")
+    p.add_argument("new")
+    p.add_argument("--alpha", type=float, default=0.01, help="significance level, default 0.01")
+    p.add_argument("--threshold", type=float, default=0.02,
+                   help="minimum relative change of the median to report, default 0.02")
+    p.add_argument("--min-samples", type=int, default=5, help="minimum repetitions per cell, default 5")
+    p.add_argument("--show-improvements", action="store_true")
+    p.set_defaults(func=command_compare)
+
+    p = commands.add_parser("alignment", help="recommend alignments from a run of AlignmentTest.cpp")
+    p.add_argument("results")
+    p.add_argument("--tolerance", type=float, default=0.05,
+                   help="throughput below the best median that is still accepted, default 0.05")
+    p.set_defaults(func=command_alignment)
+
+    args = parser.parse_args()
+    return args.func(args) or 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+"""Record traces for the trace-driven benchmarks (RecordTrace.hpp).
+
+  convert  converts a CSV of arrivals into a trace file
+  info     prints the size and timing statistics of a trace file
+
+The CSV has one record per line, either "timestamp_ns,length" or only
+"length" (all records arrive at once). Lines starting with # and a header
+line that is not numeric are skipped. Timestamps must not decrease; gaps
+above 2^32-1 ns are clamped.
+
+Only the standard library is used.
+"""
+
+import argparse
+import csv
+import struct
+import sys
+
+MAGIC = b"RBBTRACE"
+VERSION = 1
+HEADER = struct.Struct("<8sII")
+ENTRY = struct.Struct("<II")
+MAX_DELTA = 2**32 - 1
+
+
+def read_csv(path):
+    entries = []
+    previous = None
+    with open(path, newline="") as f:
+        for number, row in enumerate(csv.reader(f), 1):
+            if not row or row[0].lstrip().startswith("#"):
+                continue
+            try:
+                values = [int(v) for v in row]
+            except ValueError:
+                if entries:
+                    sys.exit(f"{path}:{number}: not a number")
+                continue
+            if len(values) == 1:
+                timestamp, length = previous or 0, values[0]
+            elif len(values) == 2:
+                timestamp, length = values
+            else:
+                sys.exit(f"{path}:{number}: expected timestamp_ns,length or length")
+            if length <= 0:
+                sys.exit(f"{path}:{number}: length must be positive")
+            if previous is not None and timestamp < previous:
+                sys.exit(f"{path}:{number}: timestamp decreases")
+            delta = 0 if previous is None else min(timestamp - previous, MAX_DELTA)
+            entries.append((delta, min(length, MAX_DELTA)))
+            previous = timestamp
+    return entries
+
+
+def write_trace(path, entries):
+    with open(path, "wb") as f:
+        f.write(HEADER.pack(MAGIC, VERSION, len(entries)))
+        for entry in entries:
+            f.write(ENTRY.pack(*entry))
+
+
+def read_trace(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    if len(data) < HEADER.size:
+        sys.exit(f"{path} is not a trace")
+    magic, version, count = HEADER.unpack_from(data)
+    if magic != MAGIC:
+        sys.exit(f"{path} is not a trace")
+    if version != VERSION:
+        sys.exit(f"{path}: trace version {version}, expected {VERSION}")
+    if len(data) < HEADER.size + count * ENTRY.size:
+        sys.exit(f"{path}: truncated, expected {count} entries")
+    return [ENTRY.unpack_from(data, HEADER.size + i * ENTRY.size) for i in range(count)]
+
+
+def percentile(values, fraction):
+    index = min(len(values) - 1, int(fraction * len(values)))
+    return values[index]
+
+
+def command_convert(args):
+    entries = read_csv(args.csv)
+    if not entries:
+        sys.exit(f"{args.csv}: no records")
+    write_trace(args.trace, entries)
+    print(f"{args.trace}: {len(entries)} records")
+
+
+def command_info(args):
+    entries = read_trace(args.trace)
+    if not entries:
+        print(f"{args.trace}: empty")
+        return
+    lengths = sorted(length for _, length in entries)
+    deltas = sorted(delta for delta, _ in entries[1:]) or [0]
+    duration = sum(delta for delta, _ in entries)
+    print(f"records   {len(entries)}")
+    print(f"bytes     {sum(lengths)}")
+    print(f"duration  {duration / 1e6:.3f} ms")
+    if duration > 0:
+        print(f"rate      {len(entries) / duration * 1e3:.3f} M records/s")
+    for name, values in (("length", lengths), ("gap ns", deltas)):
+        print(f"{name:9} min {values[0]}  p50 {percentile(values, 0.5)}  "
+              f"p99 {percentile(values, 0.99)}  max {values[-1]}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest="subcommand", required=True)
+
+    p = commands.add_parser("convert", help="convert a CSV of arrivals into a trace file")
+    p.add_argument("csv")
+    p.add_argument("trace")
+    p.set_defaults(func=command_convert)
+
+    p = commands.add_parser("info", help="print statistics of a trace file")
+    p.add_argument("trace")
+    p.set_defaults(func=command_info)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
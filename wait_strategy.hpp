@@ -0,0 +1,160 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#elif defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <climits>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define WAIT_STRATEGY_HAS_MM_PAUSE
+#endif
+
+// Wait strategies decide what a blocking queue operation does between failed
+// attempts. Each queue holds one instance per direction:
+//
+//   wait(attempt)  calls attempt until it returns true, waiting in between
+//   notify()       called by the other side after every successful operation
+//
+// attempt is the non-blocking queue operation itself, so a strategy does not
+// need to know anything about the queue it is used with. Strategies without
+// a notify() side effect compile down to the plain try-semantics.
+
+namespace wait_detail {
+
+inline void cpu_relax() noexcept {
+#if defined(WAIT_STRATEGY_HAS_MM_PAUSE)
+    _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+#endif
+}
+
+// Blocks while word == expected. May return spuriously.
+inline void park(std::atomic<uint32_t>& word, uint32_t expected) noexcept {
+#if defined(_WIN32)
+    WaitOnAddress(&word, &expected, sizeof(expected), INFINITE);
+#elif defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#else
+    (void)word;
+    (void)expected;
+    std::this_thread::yield();
+#endif
+}
+
+inline void unpark_all(std::atomic<uint32_t>& word) noexcept {
+#if defined(_WIN32)
+    WakeByAddressAll(&word);
+#elif defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#else
+    (void)word;
+#endif
+}
+
+} // namespace wait_detail
+
+// Retries immediately. Lowest latency, burns a full core while waiting.
+struct busy_spin_wait {
+    template<typename attempt_type>
+    void wait(attempt_type&& attempt) noexcept(noexcept(attempt())) {
+        while (attempt() == false) {}
+    }
+
+    void notify() noexcept {}
+};
+
+// Retries after an exponentially growing number of pause instructions. Keeps
+// the core busy, but frees execution resources for an SMT sibling and reduces
+// traffic on the contended cache line.
+template<int _max_pauses = 1024>
+struct pause_backoff_wait {
+    template<typename attempt_type>
+    void wait(attempt_type&& attempt) noexcept(noexcept(attempt())) {
+        int pauses = 1;
+        while (attempt() == false) {
+            for (int i = 0; i < pauses; i += 1) {
+                wait_detail::cpu_relax();
+            }
+            if (pauses < _max_pauses) {
+                pauses *= 2;
+            }
+        }
+    }
+
+    void notify() noexcept {}
+};
+
+// Spins for a while, then yields the time slice between attempts.
+template<int _spin_count = 100>
+struct spin_yield_wait {
+    template<typename attempt_type>
+    void wait(attempt_type&& attempt) noexcept(noexcept(attempt())) {
+        for (int i = 0; i < _spin_count; i += 1) {
+            if (attempt())
+                return;
+            wait_detail::cpu_relax();
+        }
+        while (attempt() == false) {
+            std::this_thread::yield();
+        }
+    }
+
+    void notify() noexcept {}
+};
+
+// Spins for a while, then parks the thread in the kernel (futex on Linux,
+// WaitOnAddress on Windows) until the other side notifies. Idle consumers use
+// no CPU, at the price of a full fence plus a load of _waiters in every
+// notify() and a syscall whenever someone is actually parked.
+template<int _spin_count = 100>
+struct futex_wait {
+    template<typename attempt_type>
+    void wait(attempt_type&& attempt) noexcept(noexcept(attempt())) {
+        for (int i = 0; i < _spin_count; i += 1) {
+            if (attempt())
+                return;
+            wait_detail::cpu_relax();
+        }
+
+        while (true) {
+            // _epoch has to be read before the last attempt, any notify after
+            // that changes it and makes park return immediately.
+            auto epoch = _epoch.load(std::memory_order_acquire);
+            _waiters.fetch_add(1, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            bool done = attempt();
+            if (done == false) {
+                wait_detail::park(_epoch, epoch);
+            }
+
+            _waiters.fetch_sub(1, std::memory_order_relaxed);
+            if (done)
+                return;
+        }
+    }
+
+    void notify() noexcept {
+        // pairs with the fence in wait: either the waiter sees the operation
+        // that preceded this call, or we see the waiter
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_waiters.load(std::memory_order_relaxed) != 0) {
+            _epoch.fetch_add(1, std::memory_order_release);
+            wait_detail::unpark_all(_epoch);
+        }
+    }
+
+private:
+    std::atomic<uint32_t> _epoch{ 0 };
+    std::atomic<uint32_t> _waiters{ 0 };
+};